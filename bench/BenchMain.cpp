@@ -0,0 +1,444 @@
+/**
+ * @file BenchMain.cpp
+ * @brief 描画のホットパスを単体で計測するマイクロベンチマーク
+ * @note 画面やGPUの無いビルドホストでも動くよう、GraphicsPlatform のヘッドレスバックエンド（EGL pbuffer, Mesa llvmpipe）上で実行する。
+ *       `--json <パス>` を指定すると結果をJSONでも書き出すので、コミット間で比較できる。
+ */
+#include "GLStateCache.h"
+#include "GlyphRasterizer.h"
+#include "GraphicsPlatform.h"
+#include "Renderer.h"
+#include "TelopRenderer.h"
+#include <GLES2/gl2.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifndef BENCH_SHADER_DIR
+#define BENCH_SHADER_DIR "shaders"
+#endif
+
+// テロップのケースで使うフォント（RASPI_GL_BENCH_FONT で変更できる）
+static const char *kDefaultFont = "/usr/share/fonts/truetype/vlgothic/VL-Gothic-Regular.ttf";
+
+/**
+ * @brief 各ケースの結果を集め、表とJSONで出力する
+ */
+class BenchReport
+{
+public:
+    struct Result
+    {
+        std::string name;
+        int iterations = 0;
+        double msPerIteration = 0.0;
+        std::vector<std::pair<std::string, double>> extra; // ケース固有の値（比較用の方式の時間、スループットなど）
+    };
+
+    void setRenderer(const char *renderer) { renderer_ = renderer ? renderer : ""; }
+
+    void add(const Result &result)
+    {
+        std::cout << std::fixed << std::setprecision(3) << std::left << std::setw(32) << result.name << std::right
+                  << std::setw(10) << result.msPerIteration << " ms";
+        for (const auto &value : result.extra)
+            std::cout << "  " << value.first << ": " << value.second;
+        std::cout << std::endl;
+        results_.push_back(result);
+    }
+
+    void skip(const std::string &name, const std::string &reason)
+    {
+        std::cout << std::left << std::setw(32) << name << std::right << "   skipped (" << reason << ")" << std::endl;
+        skipped_.push_back({name, reason});
+    }
+
+    bool writeJson(const std::string &path) const
+    {
+        std::ofstream out(path, std::ios::trunc);
+        if (!out)
+        {
+            std::cerr << "[Bench] Failed to open " << path << " for writing." << std::endl;
+            return false;
+        }
+        out << std::setprecision(6) << "{\n  \"renderer\": \"" << escape(renderer_) << "\",\n  \"results\": [";
+        for (size_t i = 0; i < results_.size(); ++i)
+        {
+            const Result &result = results_[i];
+            out << (i ? "," : "") << "\n    {\"name\": \"" << result.name << "\", \"iterations\": " << result.iterations
+                << ", \"ms_per_iteration\": " << result.msPerIteration;
+            for (const auto &value : result.extra)
+                out << ", \"" << value.first << "\": " << value.second;
+            out << "}";
+        }
+        out << "\n  ],\n  \"skipped\": [";
+        for (size_t i = 0; i < skipped_.size(); ++i)
+        {
+            out << (i ? "," : "") << "\n    {\"name\": \"" << skipped_[i].first << "\", \"reason\": \""
+                << escape(skipped_[i].second) << "\"}";
+        }
+        out << "\n  ]\n}\n";
+        std::cout << "[Bench] Wrote " << path << std::endl;
+        return static_cast<bool>(out);
+    }
+
+private:
+    static std::string escape(const std::string &text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                escaped.push_back('\\');
+            escaped.push_back(c);
+        }
+        return escaped;
+    }
+
+    std::string renderer_;
+    std::vector<Result> results_;
+    std::vector<std::pair<std::string, std::string>> skipped_;
+};
+
+/// @brief fn を iterations 回実行し、1回あたりの平均時間（ミリ秒）を返す
+template <typename Fn>
+static double measureMs(int iterations, Fn fn)
+{
+    fn(); // ウォームアップ
+    glFinish();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        fn();
+        glFinish(); // ドライバ内の転送完了までを計測に含める
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+}
+
+/// @brief 変更前の実装と同じく、毎フレームglTexImage2Dで確保し直してアップロードする
+static void uploadPlaneRealloc(GLuint texture, const uint8_t *data, int width, int height)
+{
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width, height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, data);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+/// @brief I420フレームのアップロード時間を、毎フレーム再確保する方式とRendererの方式で比較する
+static void benchYUVUpload(BenchReport &report, Renderer &renderer, GLStateCache &glState, int width, int height,
+                           int iterations)
+{
+    const int chromaWidth = width / 2;
+    const int chromaHeight = height / 2;
+    std::vector<uint8_t> frame(width * height + chromaWidth * chromaHeight * 2, 0x80);
+
+    Renderer::VideoPlane planes[3];
+    planes[0] = {frame.data(), width};
+    planes[1] = {frame.data() + width * height, chromaWidth};
+    planes[2] = {frame.data() + width * height + chromaWidth * chromaHeight, chromaWidth};
+
+    GLuint textures[3];
+    glGenTextures(3, textures);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    double reallocMs = measureMs(iterations, [&]()
+                                 {
+        uploadPlaneRealloc(textures[0], planes[0].data, width, height);
+        uploadPlaneRealloc(textures[1], planes[1].data, chromaWidth, chromaHeight);
+        uploadPlaneRealloc(textures[2], planes[2].data, chromaWidth, chromaHeight); });
+    glDeleteTextures(3, textures);
+    // GLStateCache を経由せずにテクスチャをバインドしたので、キャッシュを破棄する
+    glState.invalidate();
+
+    double persistentMs = measureMs(iterations, [&]()
+                                    { renderer.uploadYUVTextures(planes, width, height); });
+
+    BenchReport::Result result;
+    result.name = "upload_yuv_" + std::to_string(width) + "x" + std::to_string(height);
+    result.iterations = iterations;
+    result.msPerIteration = persistentMs;
+    result.extra.push_back({"realloc_ms", reallocMs});
+    report.add(result);
+}
+
+/// @brief I420フレームを画面全体に描くシェーダパス（YUV→RGB変換）の時間
+static void benchI420Pass(BenchReport &report, Renderer &renderer, int screenWidth, int screenHeight, int iterations)
+{
+    const int width = 1920;
+    const int height = 1080;
+    std::vector<uint8_t> frame(width * height * 3 / 2, 0x80);
+    Renderer::VideoPlane planes[3];
+    planes[0] = {frame.data(), width};
+    planes[1] = {frame.data() + width * height, width / 2};
+    planes[2] = {frame.data() + width * height * 5 / 4, width / 2};
+    renderer.uploadYUVTextures(planes, width, height);
+
+    BenchReport::Result result;
+    result.name = "i420_shader_pass_1920x1080";
+    result.iterations = iterations;
+    result.msPerIteration = measureMs(iterations, [&]()
+                                      { renderer.renderYUV(screenWidth, screenHeight); });
+    report.add(result);
+}
+
+/// @brief NV12フレーム（v4l2h264dec等の出力）を画面全体に描くシェーダパスの時間
+static void benchNV12Pass(BenchReport &report, Renderer &renderer, int screenWidth, int screenHeight, int iterations)
+{
+    const int width = 1920;
+    const int height = 1080;
+    std::vector<uint8_t> frame(width * height * 3 / 2, 0x80);
+    Renderer::VideoPlane planes[2];
+    planes[0] = {frame.data(), width};
+    planes[1] = {frame.data() + width * height, width}; // UVインターリーブ
+    renderer.uploadNV12Textures(planes, width, height);
+
+    BenchReport::Result result;
+    result.name = "nv12_shader_pass_1920x1080";
+    result.iterations = iterations;
+    result.msPerIteration = measureMs(iterations, [&]()
+                                      { renderer.renderYUV(screenWidth, screenHeight); });
+    report.add(result);
+}
+
+/// @brief lanes 行 × 50 文字の静止テロップを毎フレーム更新・描画する時間
+static void benchTelopRender(BenchReport &report, GLStateCache &glState, const char *fontPath, int lanes,
+                             int screenWidth, int screenHeight, int iterations)
+{
+    const std::string name = "telop_render_" + std::to_string(lanes * 50) + "_glyphs";
+    TelopRenderer telop;
+    if (!telop.initialize(fontPath, glState))
+    {
+        report.skip(name, std::string("font not available: ") + fontPath);
+        return;
+    }
+    telop.setScreenSize(screenWidth, screenHeight);
+
+    const std::string line = "The quick brown fox jumps over the lazy dog 0123456";
+    for (int lane = 0; lane < lanes; ++lane)
+    {
+        const int id = lane == 0 ? 0 : telop.addLane();
+        telop.setLaneFontSize(id, 24);
+        telop.setLaneScrollSpeed(id, 0.0f);
+        telop.setLanePosition(id, 20.0f, 40.0f + lane * 36.0f);
+        telop.setLaneText(id, line.substr(0, 50));
+    }
+    // グリフのラスタライズが終わり、全文字が表示されるまで待ってから計測する
+    for (int frame = 0; frame < 1000 && telop.hasPendingText(); ++frame)
+    {
+        telop.update();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    BenchReport::Result result;
+    result.name = name;
+    result.iterations = iterations;
+    result.msPerIteration = measureMs(iterations, [&]()
+                                      {
+        telop.update();
+        telop.render(); });
+    report.add(result);
+}
+
+/// @brief TelopRenderer の初期化から最初のテロップが全て表示できるまでの時間を、グリフキャッシュファイルの有無で比較する
+static void benchTelopStartup(BenchReport &report, GLStateCache &glState, const char *fontPath,
+                              int screenWidth, int screenHeight, int iterations)
+{
+    const std::string name = "telop_startup_62_glyphs";
+    const std::string text = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+    const char *cachePath = "raspi_gl_bench.glyphcache";
+    std::remove(cachePath);
+
+    // cacheFile が nullptr ならキャッシュファイルを使わない。save が真なら計測後にアトラスを保存する
+    auto startup = [&](const char *cacheFile, bool save) -> double
+    {
+        auto start = std::chrono::steady_clock::now();
+        TelopRenderer telop;
+        if (cacheFile)
+            telop.setGlyphCacheFile(cacheFile);
+        if (!telop.initialize(fontPath, glState))
+            return -1.0;
+        telop.setScreenSize(screenWidth, screenHeight);
+        telop.SetFontSize(64);
+        telop.SetText(text);
+        for (int frame = 0; frame < 1000 && telop.hasPendingText(); ++frame)
+        {
+            telop.update();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        telop.update();
+        telop.render();
+        glFinish();
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (save)
+            telop.saveGlyphCacheFile();
+        return ms;
+    };
+
+    if (startup(cachePath, true) < 0.0)
+    {
+        report.skip(name, std::string("font not available: ") + fontPath);
+        return;
+    }
+    double coldMs = 0.0;
+    double cachedMs = 0.0;
+    for (int i = 0; i < iterations; ++i)
+    {
+        coldMs += startup(nullptr, false);
+        cachedMs += startup(cachePath, false);
+    }
+    std::remove(cachePath);
+
+    BenchReport::Result result;
+    result.name = name;
+    result.iterations = iterations;
+    result.msPerIteration = cachedMs / iterations;
+    result.extra.push_back({"cold_ms", coldMs / iterations});
+    report.add(result);
+}
+
+/// @brief ワーカープールで未キャッシュのグリフをラスタライズするスループット
+static void benchGlyphRasterize(BenchReport &report, const char *fontPath, int workers)
+{
+    const std::string name = "glyph_rasterize_" + std::to_string(workers) + "_workers";
+    GlyphRasterizer rasterizer;
+    if (!rasterizer.start({fontPath}, workers))
+    {
+        report.skip(name, std::string("font not available: ") + fontPath);
+        return;
+    }
+
+    // 印字可能なASCII × 6サイズ（全て異なるグリフ）
+    const int sizes[] = {24, 32, 40, 48, 56, 64};
+    int requested = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int size : sizes)
+    {
+        for (wchar_t code = 0x21; code < 0x7F; ++code)
+        {
+            GlyphRasterizer::Request request;
+            request.code = code;
+            request.pixelSize = size;
+            request.padding = 1;
+            rasterizer.request(request);
+            ++requested;
+        }
+    }
+    GlyphRasterizer::Result result;
+    int completed = 0;
+    while (completed < requested)
+    {
+        if (rasterizer.poll(result))
+            ++completed;
+        else
+            std::this_thread::yield();
+    }
+    const double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    rasterizer.stop();
+
+    BenchReport::Result bench;
+    bench.name = name;
+    bench.iterations = requested;
+    bench.msPerIteration = totalMs / requested;
+    bench.extra.push_back({"glyphs_per_sec", requested * 1000.0 / totalMs});
+    report.add(bench);
+}
+
+/// @brief スクリーンショットと同じ形式（1920x1080 RGBA）をPNGに書き出す時間
+static void benchSavePNG(BenchReport &report, int iterations)
+{
+    const int width = 1920;
+    const int height = 1080;
+    // 圧縮率が実際の映像に近くなるよう、単色ではなく緩やかなグラデーションにする
+    std::vector<unsigned char> pixels(width * height * 4);
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            unsigned char *pixel = &pixels[(y * width + x) * 4];
+            pixel[0] = static_cast<unsigned char>(x * 255 / width);
+            pixel[1] = static_cast<unsigned char>(y * 255 / height);
+            pixel[2] = static_cast<unsigned char>((x + y) & 0xFF);
+            pixel[3] = 0xFF;
+        }
+    }
+    const char *path = "raspi_gl_bench.png";
+    BenchReport::Result result;
+    result.name = "save_pixels_png_1920x1080";
+    result.iterations = iterations;
+    result.msPerIteration = measureMs(iterations, [&]()
+                                      { GraphicsPlatform::savePixelsToPNG(path, pixels.data(), width, height); });
+    std::remove(path);
+    report.add(result);
+}
+
+int main(int argc, char **argv)
+{
+    std::string jsonPath;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        {
+            jsonPath = argv[++i];
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--json <path>]" << std::endl;
+            return 1;
+        }
+    }
+
+    // Renderer はシェーダファイルを RASPI_GL_SHADER_DIR から読む
+    setenv("RASPI_GL_SHADER_DIR", BENCH_SHADER_DIR, 0);
+    const char *fontPath = std::getenv("RASPI_GL_BENCH_FONT");
+    if (!fontPath || !*fontPath)
+        fontPath = kDefaultFont;
+
+    const int surfaceWidth = 1920;
+    const int surfaceHeight = 1080;
+    // 本体と同じGraphicsPlatformをヘッドレスバックエンドで使う。計測を待たせないよう垂直同期は模擬しない
+    GraphicsPlatform platform;
+    platform.setBackend(GraphicsPlatform::Backend::Headless);
+    platform.setHeadlessMode(surfaceWidth, surfaceHeight, 60);
+    platform.setPresentMode(GraphicsPlatform::PresentMode::SetCrtc);
+    if (!platform.initialize())
+        return 1;
+    std::cout << "[Bench] GL_RENDERER: " << glGetString(GL_RENDERER) << std::endl;
+
+    GLStateCache glState;
+    Renderer renderer;
+    if (!renderer.initialize(surfaceWidth, surfaceHeight, glState))
+    {
+        std::cerr << "[Bench] Failed to initialize Renderer." << std::endl;
+        return 1;
+    }
+
+    BenchReport report;
+    report.setRenderer(reinterpret_cast<const char *>(glGetString(GL_RENDERER)));
+    benchYUVUpload(report, renderer, glState, 1280, 720, 100);
+    benchYUVUpload(report, renderer, glState, 1920, 1080, 100);
+    benchYUVUpload(report, renderer, glState, 3840, 2160, 30);
+    benchI420Pass(report, renderer, surfaceWidth, surfaceHeight, 200);
+    benchNV12Pass(report, renderer, surfaceWidth, surfaceHeight, 200);
+    benchTelopRender(report, glState, fontPath, 1, surfaceWidth, surfaceHeight, 200);
+    benchTelopRender(report, glState, fontPath, 10, surfaceWidth, surfaceHeight, 200);
+    benchTelopStartup(report, glState, fontPath, surfaceWidth, surfaceHeight, 5);
+    benchGlyphRasterize(report, fontPath, 1);
+    const int cores = static_cast<int>(std::thread::hardware_concurrency());
+    if (cores > 1)
+        benchGlyphRasterize(report, fontPath, cores);
+    benchSavePNG(report, 5);
+
+    if (!jsonPath.empty() && !report.writeJson(jsonPath))
+        return 1;
+    return 0;
+}
@@ -6,10 +6,16 @@
 #ifndef APPLICATION_H
 #define APPLICATION_H
 
+#include "FrameProfiler.h"
+#include "GLStateCache.h"
 #include "GStreamerSupport.h"
 #include "GraphicsPlatform.h"
+#include "MetricsServer.h"
 #include "Renderer.h"
 #include "TelopRenderer.h"
+#include "TextFeed.h"
+#include <chrono>
+#include <ctime>
 
 /**
  * @class Application
@@ -39,10 +45,28 @@ private:
     GStreamerSupport gstreamer_; ///< GStreamerサポートのインスタンス
     /// @brief グラフィックスプラットフォームのインスタンス
     GraphicsPlatform platform_;
+    /// @brief RendererとTelopRendererが共有するGLステートキャッシュ（両レンダラーより後に破棄する）
+    GLStateCache glState_;
     /// @brief レンダラーのインスタンス
     Renderer renderer_;
     /// @brief テロップレンダラーのインスタンス
     TelopRenderer telopRenderer_;
+    /// @brief ティッカーの文字列を外部から受け取るテキストフィード
+    TextFeed textFeed_;
+    /// @brief フレームの段階毎の処理時間を計測するプロファイラ
+    FrameProfiler profiler_;
+    /// @brief 統計をPrometheus形式で提供するメトリクスサーバ（profiler_ を読むので、その後に宣言する）
+    MetricsServer metrics_{profiler_};
+    /// @brief 現在時刻を表示するテロップレーンの番号
+    int clockLane_ = -1;
+    /// @brief 時計レーンに表示中の時刻（秒が変わった時だけ書き換える）
+    std::time_t clockShown_ = 0;
+    /// @brief テロップレンダラーの初期化を始めた時刻（起動時間の計測用）
+    std::chrono::steady_clock::time_point telopStartTime_;
+    /// @brief 最初のテキストが表示できるまでの時間を出力したか
+    bool telopStartupLogged_ = false;
+    /// @brief 毎秒の出力に各部の統計と段階毎の処理時間を含めるか (RASPI_GL_STATS_LOG=1)
+    bool statsLog_ = false;
 };
 
 #endif // APPLICATION_H
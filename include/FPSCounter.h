@@ -16,16 +16,20 @@ public:
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastTime_).count();
         if (duration >= 1000)
         {
-            std::cout << "[FPS] " << frameCount_ << " fps" << std::endl;
+            // 出力は呼び出し側で他の統計とまとめて行う
+            lastFps_ = frameCount_;
             frameCount_ = 0;
             lastTime_ = now;
-            return true; // 1秒経過してFPSを出力した
+            return true; // 1秒経過してFPSを更新した
         }
         return false; // まだ1秒経過していない
     }
 
+    int getLastFps() const { return lastFps_; } // 直前の1秒間のフレーム数
+
 private:
     int frameCount_;
+    int lastFps_ = 0;
     std::chrono::steady_clock::time_point lastTime_;
 };
 
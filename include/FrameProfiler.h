@@ -0,0 +1,196 @@
+/**
+ * @file FrameProfiler.h
+ * @brief フレームの各段階の処理時間を計測し、パーセンタイルを集計するプロファイラの宣言
+ */
+#ifndef FRAME_PROFILER_H
+#define FRAME_PROFILER_H
+
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/**
+ * @class LatencyHistogram
+ * @brief マイクロ秒単位の処理時間を数えるHDR方式のヒストグラム。
+ * 2のべき乗毎の区間をさらに16分割した対数・線形のバケットを持ち、1us〜約70分を相対誤差6%以内で数える。
+ * record() はバケットのカウンタを atomic に加算するだけなので、集計側のスレッドとロック無しで共有できる。
+ * カウンタは累積のみで、区間毎の値は2つのスナップショットの差から求める。
+ */
+class LatencyHistogram
+{
+public:
+    static constexpr int kSubBuckets = 16;
+    static constexpr int kBucketCount = kSubBuckets + (32 - 4) * kSubBuckets;
+
+    /**
+     * @brief ある時点のカウンタの写し
+     */
+    struct Snapshot
+    {
+        std::array<uint64_t, kBucketCount> counts{}; ///< バケット毎の件数
+        uint64_t total = 0;                          ///< 件数の合計
+        uint64_t sumMicros = 0;                      ///< 値の合計（us）
+
+        /**
+         * @brief パーセンタイルを求める。
+         * @param percentile 0〜100
+         * @return その順位の値が入るバケットの上限（us）。件数が0なら0
+         */
+        uint64_t percentile(double percentile) const;
+
+        /** @brief 2つのスナップショットの差（区間内の分布）を求める。 @param earlier 前のスナップショット @return 差 */
+        Snapshot since(const Snapshot &earlier) const;
+    };
+
+    LatencyHistogram();
+
+    /** @brief 値を1件数える。 @param micros 処理時間（us） */
+    void record(uint64_t micros);
+
+    /** @brief 現在のカウンタを写し取る。 @param out 写し先 */
+    void snapshot(Snapshot &out) const;
+
+    /** @brief 前回の呼び出しからの最大値を取得し、0に戻す。 @return 最大値（us） */
+    uint64_t takeWindowMax();
+
+    /** @brief これまでの最大値を取得する。 @return 最大値（us） */
+    uint64_t getMax() const;
+
+    /** @brief バケットの上限値を取得する。 @param index バケット番号 @return 上限（us） */
+    static uint64_t bucketUpperBound(int index);
+
+private:
+    static int bucketIndex(uint64_t micros);
+
+    std::array<std::atomic<uint64_t>, kBucketCount> counts_;
+    std::atomic<uint64_t> sumMicros_{0};
+    std::atomic<uint64_t> max_{0};
+    std::atomic<uint64_t> windowMax_{0};
+};
+
+/**
+ * @class FrameProfiler
+ * @brief Application::run() の1フレームを段階毎に計測し、段階毎のヒストグラムに記録する。
+ * GL_EXT_disjoint_timer_query が使える場合は、GPUの処理時間もタイマークエリで計測する。
+ * クエリの結果は数フレーム後に読み出すので、計測のためにGPUを待つことはない。
+ */
+class FrameProfiler
+{
+public:
+    /**
+     * @brief 計測する段階
+     */
+    enum class Stage
+    {
+        FrameWait,   ///< 新しい映像フレームの取得・待機
+        Upload,      ///< YUVテクスチャへのアップロード
+        VideoDraw,   ///< 映像の描画
+        TelopUpdate, ///< テロップの更新（グリフのアップロードを含む）
+        TelopDraw,   ///< テロップの描画
+        Blit,        ///< FBOから画面への描画
+        Swap,        ///< バッファの交換とページフリップ
+        Frame,       ///< 1フレーム全体
+        Count,
+    };
+
+    /**
+     * @class ScopedStage
+     * @brief スコープの間を1つの段階として計測する。
+     */
+    class ScopedStage
+    {
+    public:
+        /**
+         * @param profiler 記録先
+         * @param stage 段階
+         * @param gpu GPUの処理時間も計測するか（タイマークエリが有効な場合のみ）
+         */
+        ScopedStage(FrameProfiler &profiler, Stage stage, bool gpu = false);
+        ~ScopedStage();
+        ScopedStage(const ScopedStage &) = delete;
+        ScopedStage &operator=(const ScopedStage &) = delete;
+
+    private:
+        FrameProfiler &profiler_;
+        Stage stage_;
+        bool gpu_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    FrameProfiler();
+    ~FrameProfiler();
+
+    /**
+     * @brief GPUタイマークエリを有効にする（GLコンテキストを作った後に呼ぶ）。
+     * @return GL_EXT_disjoint_timer_query が使えて有効になった場合はtrue
+     */
+    bool enableGpuTimers();
+
+    /** @brief GPUタイマークエリを破棄する（GLコンテキストを破棄する前に呼ぶ）。 */
+    void shutdown();
+
+    /** @brief フレームの開始時に呼ぶ。完了したGPUタイマークエリの結果を回収する。 */
+    void beginFrame();
+
+    /**
+     * @brief 段階の処理時間を記録する。
+     * @param stage 段階
+     * @param elapsed 処理時間
+     */
+    void record(Stage stage, std::chrono::steady_clock::duration elapsed);
+
+    /**
+     * @brief 前回の呼び出しから今回までの段階毎のパーセンタイルを、1段階1行で書き足す。
+     * @param out 書き足す先（呼び出し側でまとめて出力する）
+     */
+    void appendReport(std::ostream &out);
+
+    /** @brief CPU時間のヒストグラムを取得する。 @param stage 段階 @return ヒストグラム */
+    LatencyHistogram &getCpuHistogram(Stage stage);
+    /** @brief GPU時間のヒストグラムを取得する。 @param stage 段階 @return ヒストグラム */
+    LatencyHistogram &getGpuHistogram(Stage stage);
+    /** @brief GPUタイマークエリが有効か。 @return 有効ならtrue */
+    bool hasGpuTimers() const;
+
+    /** @brief 段階の名前を取得する。 @param stage 段階 @return 名前 */
+    static const char *getStageName(Stage stage);
+
+private:
+    static constexpr int kStageCount = static_cast<int>(Stage::Count);
+    // 段階毎に持つクエリの数。結果が届くまで数フレームかかるので、その間に次のフレームの計測を続けられるようにする
+    static constexpr int kQueriesPerStage = 4;
+
+    struct GpuQuery
+    {
+        GLuint id = 0;
+        bool pending = false; // 結果を回収していない
+    };
+
+    bool beginGpuQuery(Stage stage);
+    void endGpuQuery();
+
+    std::array<LatencyHistogram, kStageCount> cpu_;
+    std::array<LatencyHistogram, kStageCount> gpu_;
+    std::array<LatencyHistogram::Snapshot, kStageCount> lastCpu_;
+    std::array<LatencyHistogram::Snapshot, kStageCount> lastGpu_;
+
+    bool gpuTimers_ = false;
+    GpuQuery queries_[kStageCount][kQueriesPerStage];
+    int nextQuery_[kStageCount] = {};
+    bool queryActive_ = false; // GL_TIME_ELAPSED_EXT のクエリは同時に1つしか開始できない
+    GpuQuery *activeQuery_ = nullptr;
+
+    PFNGLGENQUERIESEXTPROC glGenQueriesEXT_ = nullptr;
+    PFNGLDELETEQUERIESEXTPROC glDeleteQueriesEXT_ = nullptr;
+    PFNGLBEGINQUERYEXTPROC glBeginQueryEXT_ = nullptr;
+    PFNGLENDQUERYEXTPROC glEndQueryEXT_ = nullptr;
+    PFNGLGETQUERYOBJECTUIVEXTPROC glGetQueryObjectuivEXT_ = nullptr;
+    PFNGLGETQUERYOBJECTUI64VEXTPROC glGetQueryObjectui64vEXT_ = nullptr;
+};
+
+#endif // FRAME_PROFILER_H
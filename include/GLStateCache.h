@@ -0,0 +1,107 @@
+/**
+ * @file GLStateCache.h
+ * @brief 冗長なGL呼び出しを省くためのGLステートキャッシュの宣言
+ */
+#ifndef GL_STATE_CACHE_H
+#define GL_STATE_CACHE_H
+
+#include <GLES2/gl2.h>
+#include <cstdint>
+#include <unordered_map>
+
+/**
+ * @class GLStateCache
+ * @brief RendererとTelopRendererが共有する、GLステートの追跡レイヤ。
+ * プログラム、テクスチャユニット、バッファ、頂点属性、ブレンド、uniform値の現在値を覚えておき、
+ * 既に同じ値が設定されている場合はGL呼び出しを省略する。
+ * @note このクラスを経由せずにステートを変更した場合は、invalidate()を呼び出すこと。
+ */
+class GLStateCache
+{
+public:
+    /**
+     * @brief 1フレーム分のGL呼び出し統計
+     */
+    struct FrameStats
+    {
+        uint32_t issued = 0; ///< 実際に発行したGL呼び出し数
+        uint32_t elided = 0; ///< 値が同じだったため省略したGL呼び出し数
+    };
+
+    /** @brief コンストラクタ。全ステートを未知として扱う。 */
+    GLStateCache();
+
+    /** @brief 全ステートを未知に戻す。キャッシュ外でGLステートを変更した後に呼び出す。 */
+    void invalidate();
+
+    /** @brief フレームの区切りを通知する。直前のフレームの統計を確定させる。 */
+    void beginFrame();
+    /** @brief 直前のフレームの統計を取得する。 @return 統計値 */
+    FrameStats getLastFrameStats() const;
+
+    void useProgram(GLuint program);
+    /// @brief 指定したテクスチャユニットにGL_TEXTURE_2Dをバインドする（必要ならアクティブユニットも切り替える）
+    void bindTexture(GLenum unit, GLuint texture);
+    void bindArrayBuffer(GLuint buffer);
+    void enableVertexAttribArray(GLuint index);
+    void disableVertexAttribArray(GLuint index);
+    /// @brief 現在バインドしているGL_ARRAY_BUFFERを対象に頂点属性を設定する
+    void vertexAttribPointer(GLuint index, GLint size, GLsizei stride, uintptr_t offset);
+    void setBlendEnabled(bool enabled);
+    void blendFunc(GLenum sfactor, GLenum dfactor);
+    void blendFuncSeparate(GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha);
+
+    /// @brief 現在のプログラムのuniformを設定する（location が -1 の場合は何もしない）
+    void uniform1i(GLint location, GLint value);
+    void uniform1f(GLint location, GLfloat value);
+    void uniform2f(GLint location, GLfloat x, GLfloat y);
+    void uniform4f(GLint location, GLfloat x, GLfloat y, GLfloat z, GLfloat w);
+
+    /// @brief 削除したテクスチャを、バインド中の記録から取り除く
+    void forgetTexture(GLuint texture);
+    /// @brief 削除したプログラムを、使用中の記録とuniform値のキャッシュから取り除く
+    void forgetProgram(GLuint program);
+
+private:
+    static constexpr int kMaxTextureUnits = 8;
+    static constexpr int kMaxVertexAttribs = 8;
+    static constexpr GLuint kUnknown = 0xFFFFFFFFu;
+
+    struct VertexAttrib
+    {
+        bool enabled = false;
+        bool known = false; // enabled が実際のステートと一致しているか
+        GLuint buffer = kUnknown;
+        GLint size = 0;
+        GLsizei stride = 0;
+        uintptr_t offset = 0;
+    };
+
+    struct UniformValue
+    {
+        GLfloat f[4];
+        GLint i;
+    };
+
+    /// @brief 値が変わる場合はtrueを返して発行数を、変わらない場合は省略数を数える
+    bool track(bool changed);
+    uint64_t uniformKey(GLint location) const;
+    bool updateUniform(GLint location, const UniformValue &value);
+
+    GLuint program_;
+    GLenum activeUnit_;
+    GLuint textures_[kMaxTextureUnits];
+    GLuint arrayBuffer_;
+    VertexAttrib attribs_[kMaxVertexAttribs];
+    int blendEnabled_; // -1: 未知, 0: 無効, 1: 有効
+    GLenum blendSrc_;
+    GLenum blendDst_;
+    GLenum blendSrcAlpha_;
+    GLenum blendDstAlpha_;
+    std::unordered_map<uint64_t, UniformValue> uniforms_;
+
+    FrameStats current_;
+    FrameStats last_;
+};
+
+#endif // GL_STATE_CACHE_H
@@ -3,15 +3,43 @@
 
 #include <gst/gst.h>
 #include <gst/app/gstappsink.h>
+#include <gst/video/video.h>
+#include <atomic>
 #include <cstdint>
+#include <string>
 #include <vector>
+#include "SpscRing.h"
 
 /**
- * @brief GStreamer から YUV(I420) 映像フレームを取得するサポートクラス
+ * @brief GStreamer から YUV(NV12/I420) 映像フレームを取得するサポートクラス
+ * @note appsinkのnew-sampleコールバック（GStreamerのストリーミングスレッド）でサンプルを
+ *       マップしてフレームキューに積み、描画スレッドはgetFrameData()でブロックせずに取り出す。
  */
 class GStreamerSupport
 {
 public:
+    /**
+     * @brief フレームキューの取り出し方針
+     */
+    enum class FrameQueuePolicy
+    {
+        /// 最新のフレームだけを返し、古いフレームは読み捨てる（満杯時も到着したフレームを残す）
+        Latest,
+        /// 到着順に1枚ずつ返す（満杯時はストリーミングスレッドを待たせる）
+        Fifo,
+    };
+
+    /**
+     * @brief フレームキューの統計
+     */
+    struct FrameQueueStats
+    {
+        uint64_t received = 0; ///< appsinkから受け取ったフレーム数
+        uint64_t dropped = 0;  ///< キュー満杯のため破棄したフレーム数
+        uint64_t skipped = 0;  ///< Latest方針で描画されずに読み捨てたフレーム数
+        size_t depth = 0;      ///< 現在キューに溜まっているフレーム数
+    };
+
     GStreamerSupport() = default;
     ~GStreamerSupport() = default;
 
@@ -20,23 +48,85 @@ public:
     bool startPipeline(const char *filepath);
     bool restartPipeline(const char *filepath);
 
+    /**
+     * @brief フレームキューの深さと方針を設定する。startPipeline()より前に呼び出すこと。
+     * @param depth キューに保持できるフレーム数
+     * @param policy 取り出し方針
+     */
+    void setFrameQueue(size_t depth, FrameQueuePolicy policy);
+
+    /**
+     * @brief H.264 のデコーダ要素を指定する。startPipeline()より前に呼び出すこと。
+     * @note 既定の avdec_h264 は8bitのH.264をI420で出力するので、NV12のアップロードパスを使うには
+     *       NV12を出力するデコーダ（Raspberry Pi の v4l2h264dec など）を指定する。
+     *       要素が見つからない場合は avdec_h264 を使う。
+     * @param element GStreamer の要素名。nullptrまたは空文字なら既定の avdec_h264
+     */
+    void setVideoDecoder(const char *element);
+
+    /**
+     * @brief フレームの画素フォーマット
+     */
+    enum class PixelFormat
+    {
+        I420, ///< Y, U, V の3プレーン
+        NV12, ///< Y と UVインターリーブの2プレーン
+    };
+
+    /// @brief 1フレームが持つ最大プレーン数（I420の3プレーン）
+    static constexpr int kMaxPlanes = 3;
+
     struct FrameData
     {
+        PixelFormat format = PixelFormat::I420;
         uint8_t *data = nullptr;
         int width = 0;
         int height = 0;
-        int stride = 0;
+        int stride = 0;                       // 先頭プレーン(Y)のストライド（バイト）
+        int planeCount = 0;                   // プレーン数 (I420: 3, NV12: 2)
+        size_t planeOffset[kMaxPlanes] = {};  // data先頭から各プレーンまでのオフセット（バイト）
+        int planeStride[kMaxPlanes] = {};     // 各プレーンの1行あたりのバイト数（パディング込み）
         GstSample *sample = nullptr; // 追加
         GstMapInfo map;              // 追加
+        uint64_t sequence = 0;       // appsinkから受け取った順番（Latest方針で新しい方を選ぶため）
+        int64_t ptsMicros = -1;      // 表示時刻（us）。不明なら-1
     };
 
+    /**
+     * @brief キューからフレームを取り出す。ブロックしない。
+     * @param outFrame 取り出したフレーム。使用後はreleaseFrame()で解放すること。
+     * @return フレームを取り出せた場合はtrue、キューが空の場合はfalse。
+     */
     bool getFrameData(FrameData &outFrame);
     bool checkBusMessages();
     void releaseFrame(FrameData &frame);
 
+    /** @brief フレームキューの統計を取得する。 @return 統計値 */
+    FrameQueueStats getFrameQueueStats() const;
+
 private:
+    /// @brief appsinkに新しいサンプルが届いた時にストリーミングスレッドから呼ばれる
+    static GstFlowReturn onNewSample(GstAppSink *sink, gpointer user_data);
+    /// @brief キューに残っているフレームを全て解放する
+    void drainFrameQueue();
+    /// @brief パイプラインを作成して再生を開始し、プリロールの完了を待つ
+    bool launchPipeline(const std::string &pipelineDesc);
+
     GstElement *pipeline_ = nullptr;
     GstElement *appsink_ = nullptr;
+
+    SpscRing<FrameData> frameQueue_{4};
+    /// @brief Latest方針でキューが満杯の時に、最新のフレームを置いておく上書き用の枠（ストリーミングスレッドが書く）
+    std::atomic<FrameData *> overflowFrame_{nullptr};
+    FrameQueuePolicy queuePolicy_ = FrameQueuePolicy::Latest;
+    /// @brief H.264 のデコーダ要素名
+    std::string videoDecoder_ = "avdec_h264";
+    /// @brief 受け取った映像の形式を出力したか（パイプラインの開始毎に1回だけ出力する）
+    std::atomic<bool> formatLogged_{false};
+    std::atomic<bool> stopping_{false};
+    std::atomic<uint64_t> framesReceived_{0};
+    std::atomic<uint64_t> framesDropped_{0};
+    std::atomic<uint64_t> framesSkipped_{0};
 };
 
 #endif // GSTREAMER_SUPPORT_H
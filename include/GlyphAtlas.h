@@ -0,0 +1,180 @@
+/**
+ * @file GlyphAtlas.h
+ * @brief グリフのα画像をまとめて格納するテクスチャアトラスの宣言
+ */
+#ifndef GLYPH_ATLAS_H
+#define GLYPH_ATLAS_H
+
+#include <GLES2/gl2.h>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+class GLStateCache;
+
+/**
+ * @class GlyphAtlas
+ * @brief 大きなGL_ALPHAテクスチャ（ページ）にグリフをシェルフ方式で詰め込むアトラス。
+ * ページが一杯になったら、上限に達するまで新しいページを追加する。
+ * release() で解放した領域は、同じ大きさ以下のグリフの格納に再利用する。小さなグリフに使う場合は
+ * 余りを別の空き領域として切り分け、ページ全体が不要になれば resetPage() で棚ごと作り直せる。
+ * 隣接するグリフの間には gutter ピクセルの透明な隙間を空け、アウトライン描画時の近傍サンプリングが
+ * 隣のグリフに届かないようにする。
+ */
+class GlyphAtlas
+{
+public:
+    /**
+     * @brief アトラス内の1グリフ分の領域
+     */
+    struct Region
+    {
+        int page = -1;   ///< 格納したページ番号
+        int x = 0;       ///< ページ内の左上X（ピクセル）
+        int y = 0;       ///< ページ内の左上Y（ピクセル）
+        int width = 0;   ///< 幅（ピクセル）
+        int height = 0;  ///< 高さ（ピクセル）
+        float u0 = 0.0f; ///< 左端のU
+        float v0 = 0.0f; ///< 上端のV（画像の1行目）
+        float u1 = 0.0f; ///< 右端のU
+        float v1 = 0.0f; ///< 下端のV
+        int slotWidth = 0;  ///< 確保した枠の幅（gutter込み。解放時にこの大きさで再利用される）
+        int slotHeight = 0; ///< 確保した枠の高さ（gutter込み）
+    };
+
+    GlyphAtlas();
+    ~GlyphAtlas();
+
+    /**
+     * @brief アトラスを初期化する。ページはinsert()で必要になった時点で確保する。
+     * @param glState テクスチャのバインドに使うGLステートキャッシュ
+     * @param pageSize 1ページの一辺（GL_MAX_TEXTURE_SIZE を超える場合は切り詰める）
+     * @param gutter グリフ間に空ける透明な隙間（ピクセル）
+     */
+    void initialize(GLStateCache &glState, int pageSize, int gutter);
+
+    /**
+     * @brief ページ数の上限を設定する。
+     * @param maxPages 上限（0 は無制限）
+     */
+    void setMaxPages(int maxPages);
+
+    /**
+     * @brief ページの内容をCPU側にも保持する（save() に必要。ページと同じ量のメモリを使う）。
+     * @param keep 保持する場合はtrue（ページを確保する前に呼ぶ）
+     */
+    void setKeepPixels(bool keep);
+
+    /** @brief 全ページのテクスチャを破棄する。 */
+    void shutdown();
+
+    /**
+     * @brief 全ページの画素と空き領域の状態を書き出す（setKeepPixels(true) が必要）。
+     * @param out 書き出し先
+     * @return 書き出せた場合はtrue
+     */
+    bool save(std::ostream &out) const;
+
+    /**
+     * @brief save() で書き出した内容から全ページを作り直す。画素は data から直接テクスチャへ転送する。
+     * @param data save() で書き出したデータ（mmap した領域をそのまま渡せる）
+     * @param size data のバイト数
+     * @param outConsumed 読み込んだバイト数
+     * @return 読み込めた場合はtrue。ページの大きさが違う場合、上限を超える場合、棚や空き領域がページの外を指す場合は
+     *         false（アトラスは空になる）。
+     */
+    bool load(const uint8_t *data, size_t size, size_t &outConsumed);
+
+    /**
+     * @brief 領域が確保済みのページの内側にあるか（ファイルから読み込んだ領域の検証用）。
+     * @param region 調べる領域
+     * @return ページの内側にあり、画像が枠に収まっている場合はtrue
+     */
+    bool isValidRegion(const Region &region) const;
+
+    /**
+     * @brief α画像をアトラスに格納する。
+     * @param pixels 1行 width バイト、上の行から並んだα画像
+     * @param width 画像の幅
+     * @param height 画像の高さ
+     * @param outRegion 格納した領域
+     * @return 格納できた場合はtrue。画像が1ページより大きい場合や、ページ数が上限に達して空きが無い場合はfalse。
+     */
+    bool insert(const uint8_t *pixels, int width, int height, Region &outRegion);
+
+    /**
+     * @brief insert() で確保した領域を解放し、以降の格納で再利用できるようにする。
+     * @param region 解放する領域
+     */
+    void release(const Region &region);
+
+    /** @brief width x height のグリフが1ページに収まるか。 @return 収まる場合はtrue */
+    bool fitsInPage(int width, int height) const;
+
+    /**
+     * @brief region を解放すれば、width x height のグリフを格納できるか。
+     * @param region 解放を検討する領域
+     * @param width 格納したい画像の幅
+     * @param height 格納したい画像の高さ
+     * @return 格納できる場合はtrue
+     */
+    bool canReuse(const Region &region, int width, int height) const;
+
+    /**
+     * @brief ページ全体を空にし、棚の配置を最初からやり直せるようにする（そのページの領域は全て無効になる）。
+     * @param page ページ番号
+     */
+    void resetPage(int page);
+
+    /** @brief ページのテクスチャを取得する。 @param page ページ番号 @return テクスチャID */
+    GLuint getPageTexture(int page) const;
+    /** @brief 確保済みのページ数を取得する。 @return ページ数 */
+    int getPageCount() const;
+    /** @brief 1ページの一辺を取得する。 @return ピクセル数 */
+    int getPageSize() const;
+    /** @brief 確保済みページが使うテクスチャメモリの量を取得する。 @return バイト数 */
+    size_t getTextureBytes() const;
+
+private:
+    // 同じ高さ帯にグリフを左から並べていく1段分の棚
+    struct Shelf
+    {
+        int y = 0;      // 棚の上端
+        int height = 0; // 棚の高さ（gutter込み）
+        int x = 0;      // 次にグリフを置く位置
+    };
+
+    // release() で解放された枠
+    struct FreeSlot
+    {
+        int x = 0;
+        int y = 0;
+        int width = 0;
+        int height = 0;
+    };
+
+    struct Page
+    {
+        GLuint texture = 0;
+        std::vector<Shelf> shelves;
+        std::vector<FreeSlot> freeSlots;
+        int nextShelfY = 0;          // 次に棚を追加する位置
+        std::vector<uint8_t> pixels; // keepPixels_ の場合のみ、テクスチャと同じ内容を持つ
+    };
+
+    bool addPage(const uint8_t *pixels = nullptr);
+    bool isInsidePage(int x, int y, int width, int height) const;
+    void writePixels(Page &page, int x, int y, int width, int height, const uint8_t *pixels);
+    bool allocate(Page &page, int width, int height, int &outX, int &outY, int &outSlotWidth, int &outSlotHeight);
+
+    GLStateCache *glState_ = nullptr;
+    std::vector<Page> pages_;
+    int pageSize_ = 0;
+    int gutter_ = 0;
+    int maxPages_ = 0;
+    bool keepPixels_ = false;
+    std::vector<uint8_t> zeros_; // 領域を消すための透明な画素（使い回す）
+};
+
+#endif // GLYPH_ATLAS_H
@@ -0,0 +1,170 @@
+/**
+ * @file GlyphCache.h
+ * @brief アトラスに格納済みのグリフを管理する、LRU方式のキャッシュの宣言
+ */
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+#include "GlyphAtlas.h"
+
+/**
+ * @class GlyphCache
+ * @brief キーからアトラス上のグリフを引くハッシュテーブルと、最近使われた順のリストを持つキャッシュ。
+ * グリフは1本の配列に詰めて持ち、線形探査のハッシュテーブルはその添字を、LRU のリストは前後の添字を持つ
+ * （ノード毎のメモリ確保が無く、CJK の文字が数千種類に増えても探索は連続したメモリの上で済む）。
+ * キーはフォント・サイズ・文字コードを合わせた64bitなので、BMP の文字コードで直接引く表にはしていない。
+ * 容量の管理はアトラス側（ページ数の上限）で行い、アトラスが一杯になった時に evictLeastRecentlyUsedIf() で
+ * 新しいグリフが収まる枠を持つもののうち最も長く使われていないグリフを追い出し、その枠を再利用する。
+ */
+class GlyphCache
+{
+public:
+    using Key = uint64_t;
+
+    /**
+     * @brief キャッシュしたグリフ1つ分の情報
+     */
+    struct Glyph
+    {
+        GlyphAtlas::Region region; ///< アトラス内の格納位置
+        int width;                 ///< 画像の幅（パディング込み）
+        int height;                ///< 画像の高さ（パディング込み）
+        int bearingX;              ///< ペン位置から画像左端まで
+        int bearingY;              ///< ベースラインから画像上端まで
+        int advance;               ///< 次の文字までの送り幅
+    };
+
+    /**
+     * @brief キャッシュの統計
+     */
+    struct Stats
+    {
+        uint64_t hits = 0;      ///< lookup() で見つかった回数
+        uint64_t misses = 0;    ///< lookup() で見つからなかった回数
+        uint64_t evictions = 0; ///< 追い出したグリフ数
+        size_t glyphs = 0;      ///< 現在キャッシュしているグリフ数
+    };
+
+    /**
+     * @brief 統計を更新せずにグリフを探す（毎フレームの描画用）。
+     * @param key キー
+     * @return 見つかった場合はグリフ、無い場合はnullptr（次の追加・追い出しまで有効）
+     */
+    const Glyph *find(Key key) const;
+
+    /**
+     * @brief グリフを探し、ヒット/ミスを数えて最近使ったものとして扱う。
+     * @param key キー
+     * @return 見つかった場合はグリフ、無い場合はnullptr
+     */
+    const Glyph *lookup(Key key);
+
+    /**
+     * @brief 統計を更新せずに、グリフを最近使ったものとして扱う（表示を終えた文字列のグリフ用）。
+     * @param key キー（無ければ何もしない）
+     */
+    void touch(Key key);
+
+    /** @brief グリフを追加する（既にある場合は置き換える）。 */
+    void insert(Key key, const Glyph &glyph);
+
+    /**
+     * @brief pinned に含まれず fn が true を返すもののうち、最も長く使われていないグリフを取り除く。
+     * @param pinned 追い出してはいけないキー
+     * @param fn const Glyph& を受け取り、追い出してよいかを返す関数
+     * @param outGlyph 取り除いたグリフ
+     * @param outKey 取り除いたグリフのキーの格納先（不要ならnullptr）
+     * @return 取り除けた場合はtrue
+     */
+    template <typename Fn>
+    bool evictLeastRecentlyUsedIf(const std::unordered_set<Key> &pinned, Fn fn, Glyph &outGlyph, Key *outKey = nullptr)
+    {
+        for (uint32_t index = tail_; index != kNone; index = nodes_[index].prev)
+        {
+            const Node &node = nodes_[index];
+            if (pinned.count(node.key) || !fn(static_cast<const Glyph &>(node.glyph)))
+                continue;
+            outGlyph = node.glyph;
+            if (outKey)
+                *outKey = node.key;
+            erase(index);
+            stats_.evictions++;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief pinned に含まれず fn が true を返すグリフを全て取り除く。
+     * @param pinned 追い出してはいけないキー
+     * @param fn const Glyph& を受け取り、追い出してよいかを返す関数
+     * @return 取り除いたグリフ数
+     */
+    template <typename Fn>
+    size_t evictAllIf(const std::unordered_set<Key> &pinned, Fn fn)
+    {
+        size_t evicted = 0;
+        for (uint32_t index = head_; index != kNone;)
+        {
+            const Node &node = nodes_[index];
+            uint32_t next = node.next;
+            if (!pinned.count(node.key) && fn(static_cast<const Glyph &>(node.glyph)))
+            {
+                // 末尾のノードが空いた位置へ移るので、次に辿るのがそのノードなら移動先を辿る
+                if (erase(index) == next)
+                    next = index;
+                ++evicted;
+            }
+            index = next;
+        }
+        stats_.evictions += evicted;
+        return evicted;
+    }
+
+    /** @brief 全グリフを取り除く（統計は残す）。 */
+    void clear();
+
+    /** @brief 統計を取得する。 @return 統計値 */
+    Stats getStats() const;
+
+    /**
+     * @brief 全グリフを、最も長く使われていないものから順に列挙する（この順に insert() すれば LRU の順序が再現される）。
+     * @param fn Key と const Glyph& を受け取る関数
+     */
+    template <typename Fn>
+    void forEachLeastRecentFirst(Fn fn) const
+    {
+        for (uint32_t index = tail_; index != kNone; index = nodes_[index].prev)
+            fn(nodes_[index].key, static_cast<const Glyph &>(nodes_[index].glyph));
+    }
+
+private:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    struct Node
+    {
+        Key key;
+        Glyph glyph;
+        uint32_t prev; // LRU のリストで1つ新しいノード（無ければ kNone）
+        uint32_t next; // LRU のリストで1つ古いノード（無ければ kNone）
+    };
+
+    size_t findSlot(Key key) const;
+    uint32_t findIndex(Key key) const;
+    void grow();
+    void unlink(uint32_t index);
+    void pushFront(uint32_t index);
+    uint32_t erase(uint32_t index);
+
+    std::vector<Node> nodes_;   // グリフを隙間なく詰めた配列
+    std::vector<uint32_t> table_; // nodes_ の添字を引く線形探査のハッシュテーブル（大きさは2のべき乗、空きは kNone）
+    uint32_t head_ = kNone;     // 最も最近使われたノード
+    uint32_t tail_ = kNone;     // 最も長く使われていないノード
+    Stats stats_;
+};
+
+#endif // GLYPH_CACHE_H
@@ -0,0 +1,65 @@
+/**
+ * @file GlyphCacheFile.h
+ * @brief グリフアトラスとグリフ情報をディスクに保存し、次回の起動で再利用するキャッシュファイルの宣言
+ */
+#ifndef GLYPH_CACHE_FILE_H
+#define GLYPH_CACHE_FILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "GlyphAtlas.h"
+#include "GlyphCache.h"
+
+/**
+ * @class GlyphCacheFile
+ * @brief ラスタライズ済みのアトラスページとグリフ情報（キーと寸法）を1つのファイルに保存する。
+ * 読み込みはファイルを mmap し、ページの画素をそのままテクスチャへ転送するので、起動時に FreeType を使わずに済む。
+ * ファイルにはバージョンとフォント・アトラスの設定（Identity）を記録し、一致しない場合は読み込まない。
+ * グリフのスタイル（サイズ・アウトライン幅・SDF）はキーに含まれるので、複数のスタイルを1つのファイルに持てる。
+ */
+class GlyphCacheFile
+{
+public:
+    /**
+     * @brief キャッシュの内容を決める設定。保存時と読み込み時で全て一致する必要がある。
+     */
+    struct Identity
+    {
+        std::vector<uint64_t> fontHashes; ///< フォント番号順のフォントファイルの識別値（hashFont()）
+        int32_t pageSize = 0;             ///< アトラス1ページの一辺
+        int32_t gutter = 0;               ///< グリフ間の隙間
+        int32_t sdfBaseSize = 0;          ///< SDFを生成する基準サイズ
+        int32_t sdfSpread = 0;            ///< SDFの距離の範囲
+    };
+
+    /**
+     * @brief フォントファイルの識別値を求める。
+     * @note 起動を速くするためにファイルの中身は読まず、パス・サイズ・更新時刻から求める。
+     * @param path フォントファイルのパス
+     * @return 識別値。ファイルが無い場合は0
+     */
+    static uint64_t hashFont(const std::string &path);
+
+    /**
+     * @brief キャッシュファイルを読み込み、アトラスとキャッシュを置き換える。
+     * @param path キャッシュファイルのパス
+     * @param identity 現在の設定
+     * @param atlas 読み込み先のアトラス（初期化済みであること）
+     * @param cache 読み込み先のキャッシュ
+     * @return 読み込めた場合はtrue。ファイルが無い・壊れている・設定が違う場合はfalse（アトラスとキャッシュは空になる）。
+     */
+    static bool load(const std::string &path, const Identity &identity, GlyphAtlas &atlas, GlyphCache &cache);
+
+    /**
+     * @brief アトラスとキャッシュの内容をキャッシュファイルに保存する（一時ファイルに書いてから置き換える）。
+     * @param path キャッシュファイルのパス
+     * @param identity 現在の設定
+     * @param atlas 保存するアトラス（setKeepPixels(true) で画素を保持していること）
+     * @param cache 保存するキャッシュ
+     * @return 保存できた場合はtrue
+     */
+    static bool save(const std::string &path, const Identity &identity, const GlyphAtlas &atlas, const GlyphCache &cache);
+};
+
+#endif // GLYPH_CACHE_FILE_H
@@ -0,0 +1,114 @@
+/**
+ * @file GlyphRasterizer.h
+ * @brief グリフのラスタライズを描画スレッドの外で行うワーカープールの宣言
+ */
+#ifndef GLYPH_RASTERIZER_H
+#define GLYPH_RASTERIZER_H
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SpscRing.h"
+
+/**
+ * @class GlyphRasterizer
+ * @brief FreeTypeによるグリフのラスタライズ（とSDF生成）をワーカースレッドで行う。
+ * FT_Face はスレッドセーフではないため、ワーカー毎に FT_Library と FT_Face を持つ。
+ * 結果はワーカー毎の SpscRing に積まれ、描画スレッドが poll() で受け取ってアトラスへアップロードする。
+ */
+class GlyphRasterizer
+{
+public:
+    /**
+     * @brief 出力するα画像の形式
+     */
+    enum class Format
+    {
+        Alpha, ///< FreeTypeのα画像をそのまま使う
+        SDF,   ///< α画像から生成した符号付き距離場
+    };
+
+    /**
+     * @brief ラスタライズの依頼
+     */
+    struct Request
+    {
+        wchar_t code = 0;              ///< 文字コード
+        int face = 0;                  ///< start() に渡したフォントの番号
+        int pixelSize = 64;            ///< ラスタライズするピクセルサイズ
+        int padding = 0;               ///< 画像の四辺に追加する透明な余白（ピクセル）
+        Format format = Format::Alpha; ///< 出力形式
+        int sdfSpread = 0;             ///< SDFで輪郭の内外に持たせる距離の範囲（ピクセル）
+    };
+
+    /**
+     * @brief ラスタライズの結果
+     */
+    struct Result
+    {
+        Request request;                   ///< 依頼内容
+        bool ok = false;                   ///< ラスタライズに成功したか
+        std::vector<unsigned char> pixels; ///< 余白込みのα画像（1行 width バイト）
+        int width = 0;                     ///< 余白込みの幅
+        int height = 0;                    ///< 余白込みの高さ
+        int bearingX = 0;                  ///< ペン位置から画像左端まで（余白込み）
+        int bearingY = 0;                  ///< ベースラインから画像上端まで（余白込み）
+        int advance = 0;                   ///< 次の文字までの送り幅
+    };
+
+    GlyphRasterizer();
+    ~GlyphRasterizer();
+
+    /**
+     * @brief ワーカースレッドを起動する。
+     * @param fontPaths フォントファイルのパス（並び順が Request::face の番号になる）
+     * @param workerCount ワーカー数（1未満は1として扱う）
+     * @return 全ワーカーが全フォントを読み込めた場合はtrue
+     */
+    bool start(const std::vector<std::string> &fontPaths, int workerCount);
+
+    /** @brief 全ワーカーを停止し、未処理の依頼を破棄する。 */
+    void stop();
+
+    /** @brief ワーカーが動作中か。 @return 動作中ならtrue */
+    bool isRunning() const;
+
+    /** @brief ラスタライズを依頼する（描画スレッドから呼ぶ）。 @param request 依頼内容 */
+    void request(const Request &request);
+
+    /**
+     * @brief 完了した結果を1つ受け取る（描画スレッドから呼ぶ）。
+     * @param out 結果の格納先
+     * @return 結果があった場合はtrue
+     */
+    bool poll(Result &out);
+
+private:
+    struct Worker
+    {
+        std::thread thread;
+        FT_Library library = nullptr;
+        std::vector<FT_Face> faces;
+        std::vector<int> pixelSizes; // 各 face に現在設定しているピクセルサイズ
+        SpscRing<Result> results;
+    };
+
+    void workerLoop(Worker &worker);
+    static void rasterize(Worker &worker, const Request &request, Result &result);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::deque<Request> jobs_;
+    std::mutex jobsMutex_;
+    std::condition_variable jobsCondition_;
+    std::atomic<bool> stopping_{false};
+    size_t nextPoll_ = 0; // 結果を受け取るワーカーを巡回する位置
+};
+
+#endif // GLYPH_RASTERIZER_H
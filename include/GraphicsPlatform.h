@@ -10,16 +10,42 @@
 #include <gbm.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
+#include <chrono>
 #include <cstdint>
+#include <string>
+#include <vector>
 
 /**
  * @class GraphicsPlatform
  * @brief DRM/KMS/GBM/EGLといった低レベルAPIを管理し、OSとハードウェアの差異を抽象化するクラス。
  * ウィンドウの作成、描画コンテキストの管理、画面の更新などを担当する。
+ * ディスプレイの無い環境（CIコンテナ、ソークテスト、事前レンダリング）向けに、EGL pbuffer 上で動く
+ * ヘッドレスバックエンドも持つ。どちらのバックエンドでも Application の描画ループは同じように動く。
  */
 class GraphicsPlatform
 {
 public:
+    /**
+     * @brief 描画先のバックエンド
+     */
+    enum class Backend
+    {
+        /// DRM/KMS の CRTC へ GBM のスキャンアウトバッファを表示する
+        Drm,
+        /// EGL surfaceless（Mesa llvmpipe など）の pbuffer へ描画し、フレームは任意でシンクへ書き出す
+        Headless,
+    };
+    /**
+     * @brief 描画結果を画面へ反映する方式
+     */
+    enum class PresentMode
+    {
+        /// 毎フレーム drmModeSetCrtc() でモードセットする（従来方式、ブロッキング）
+        SetCrtc,
+        /// drmModePageFlip() で垂直同期に合わせて切り替え、フリップ完了イベントで完了を検知する
+        PageFlip,
+    };
+
     /** @brief コンストラクタ */
     GraphicsPlatform();
     /** @brief デストラクタ。自動的にshutdown()を呼び出す。 */
@@ -41,15 +67,152 @@ public:
      */
     void swapBuffers();
 
+    /**
+     * @brief 画面更新方式を設定する。initialize()より前に呼び出すこと。
+     * @param mode 画面更新方式
+     */
+    void setPresentMode(PresentMode mode);
+    /** @brief 現在の画面更新方式を取得する。 @return 画面更新方式 */
+    PresentMode getPresentMode() const;
+
+    /**
+     * @brief バックエンドを設定する。initialize()より前に呼び出すこと。
+     * @param backend バックエンド
+     */
+    void setBackend(Backend backend);
+    /** @brief 現在のバックエンドを取得する。 @return バックエンド */
+    Backend getBackend() const;
+
+    /**
+     * @brief ヘッドレスバックエンドの解像度とリフレッシュレートを設定する。initialize()より前に呼び出すこと。
+     * @note PageFlipモードではこのレートの仮想的な垂直同期に合わせて swapBuffers() が待つ。
+     *       SetCrtcモードでは待たずに描画できる速さで進む（事前レンダリング向け）。
+     * @param width 幅
+     * @param height 高さ
+     * @param refreshHz リフレッシュレート
+     */
+    void setHeadlessMode(int width, int height, int refreshHz);
+
+    /**
+     * @brief ヘッドレスバックエンドで、表示したフレームを書き出す先を指定する。initialize()より前に呼び出すこと。
+     * @note 上の行から順に並べた RGBA の生データを1フレームずつ書き込む。FIFO を指定すれば
+     *       ffmpeg -f rawvideo -pix_fmt rgba などへそのまま渡せる。書き込みはブロックせず、読み手が追いつかず
+     *       前のフレームを書き終えていない間に表示したフレームは書き出さない（フレームの途中で切れることはない）。
+     * @param path ファイルまたは FIFO のパス。nullptrまたは空文字なら書き出さない。
+     */
+    void setFrameSink(const char *path);
+
+    /**
+     * @brief 使用するDRMデバイスのパスを指定する。initialize()より前に呼び出すこと。
+     * @param path デバイスパス（例: /dev/dri/card1）。nullptrまたは空文字なら自動検出。
+     */
+    void setDrmDevicePath(const char *path);
+
     /** @brief 画面の幅を取得する。 @return 画面の幅（ピクセル数）。 */
     uint32_t getScreenWidth() const;
     /** @brief 画面の高さを取得する。 @return 画面の高さ（ピクセル数）。 */
     uint32_t getScreenHeight() const;
 
+    /**
+     * @brief GBMバッファに紐付けたDRMフレームバッファIDの利用統計
+     */
+    struct FramebufferStats
+    {
+        /// drmModeAddFB()を実際に呼び出した回数
+        uint64_t addCalls = 0;
+        /// キャッシュ済みのIDを再利用し、drmModeAddFB()を省略できた回数
+        uint64_t addCallsAvoided = 0;
+    };
+    /** @brief フレームバッファIDキャッシュの統計を取得する。 @return 統計値 */
+    FramebufferStats getFramebufferStats() const;
+
+    /**
+     * @brief ページフリップの統計
+     */
+    struct FlipStats
+    {
+        /// 完了したページフリップの数
+        uint64_t flips = 0;
+        /// 直前のフリップから1フレーム以上空いた（垂直同期に間に合わなかった）回数の合計
+        uint64_t missedVblanks = 0;
+    };
+    /** @brief ページフリップの統計を取得する。 @return 統計値 */
+    FlipStats getFlipStats() const;
+
+    /**
+     * @brief 表示モードの1フレームの長さを取得する。
+     * @return ピクセルクロックと総画素数から求めたリフレッシュ間隔
+     */
+    std::chrono::nanoseconds getRefreshInterval() const;
+
+    /**
+     * @brief これから描画するフレームが画面に表示される時刻を予測する。
+     * @note PageFlipモードでは直近のフリップ完了イベントのタイムスタンプを起点に、次の垂直同期
+     *       （前のフリップが未完了ならさらにその次）の時刻を返す。タイムスタンプが無い場合
+     *       （SetCrtcモードや最初のフリップ前）は現在時刻を返す。
+     * @return 予測した表示時刻（steady_clock。LinuxではDRMと同じCLOCK_MONOTONIC）
+     */
+    std::chrono::steady_clock::time_point predictPresentTime() const;
+
     void saveFramebufferToPNG(const char *filename);
     bool savePixelsToPNG(const char *filename, const unsigned char *data);
+    /**
+     * @brief RGBAの画素（下の行から順、glReadPixelsの並び）をPNG形式で保存する。
+     * @param filename 保存するファイル名
+     * @param data ピクセルデータ（RGBA形式）
+     * @param width 幅
+     * @param height 高さ
+     * @return 保存できた場合はtrue
+     */
+    static bool savePixelsToPNG(const char *filename, const unsigned char *data, int width, int height);
 
 private:
+    /// @brief PageFlipモードを諦めて SetCrtc に切り替えるまでの、drmModePageFlip()の連続失敗回数
+    static constexpr int kMaxFlipFailures = 60;
+
+    /// @brief GBMバッファに対応するDRMフレームバッファIDを取得する（未登録ならAddFBしてキャッシュする）
+    uint32_t getFramebufferId(struct gbm_bo *bo);
+    /// @brief GBMバッファ破棄時に呼ばれ、紐付けたDRMフレームバッファを削除する
+    static void destroyFramebufferUserData(struct gbm_bo *bo, void *data);
+    /// @brief キュー済みのページフリップが完了するまで待つ
+    void waitForPendingFlip();
+    /// @brief 完了イベントが届かなかったフリップの待ち状態を解除する
+    void abandonPendingFlip();
+    /// @brief drmHandleEvent()から呼ばれるページフリップ完了ハンドラ（user_data はフリップの通し番号）
+    static void onPageFlipComplete(int fd, unsigned int sequence, unsigned int tv_sec,
+                                   unsigned int tv_usec, void *user_data);
+    /// @brief 表示モードからリフレッシュ間隔を求める
+    void updateRefreshInterval();
+    /// @brief 表示された時刻を記録し、間に合わなかった垂直同期を数える
+    void recordFlip(std::chrono::steady_clock::time_point flipTime);
+    /// @brief ヘッドレスバックエンドを初期化する
+    bool initializeHeadless();
+    /// @brief ヘッドレスバックエンドでフレームを表示（シンクへ書き出し、仮想の垂直同期を待つ）する
+    void presentHeadless();
+    /// @brief 書き出し中のフレームの残りをシンクへ書ける分だけ書き込む（ブロックしない）
+    bool writeFrameSink();
+
+    /// @brief 描画先のバックエンド
+    Backend backend_ = Backend::Drm;
+    /// @brief ヘッドレスバックエンドの解像度とリフレッシュレート
+    int headless_width_ = 1920;
+    int headless_height_ = 1080;
+    int headless_refresh_hz_ = 60;
+    /// @brief フレームの書き出し先のパスとファイルディスクリプタ
+    std::string frame_sink_path_;
+    int frame_sink_fd_ = -1;
+    /// @brief 書き出すフレームの読み出し先（上下反転前）と書き出し用（上の行から順）のバッファ
+    std::vector<unsigned char> sink_pixels_;
+    std::vector<unsigned char> sink_frame_;
+    /// @brief sink_frame_ のうち書き込み済みのバイト数と、シンクが詰まっていて書き出さなかったフレーム数
+    size_t sink_written_ = 0;
+    uint64_t sink_dropped_frames_ = 0;
+
+    /// @brief 画面更新方式
+    PresentMode present_mode_ = PresentMode::PageFlip;
+    /// @brief ユーザーが指定したDRMデバイスのパス（空なら自動検出）
+    std::string drm_device_path_;
+
     // --- EGL関連のリソース ---
     /// @brief EGLディスプレイ接続ハンドル
     EGLDisplay display_ = EGL_NO_DISPLAY;
@@ -85,8 +248,37 @@ private:
     // --- バッファ管理 ---
     /// @brief 前のフレームで表示したGBMバッファオブジェクト
     struct gbm_bo *previous_bo_ = nullptr;
-    /// @brief 前にフレームで表示したDRMフレームバッファのID
-    uint32_t previous_fb_id_ = 0;
+    /// @brief ページフリップ待ちのGBMバッファオブジェクト
+    struct gbm_bo *pending_bo_ = nullptr;
+    /// @brief ページフリップがキューされ、完了イベント待ちの状態か
+    bool flip_pending_ = false;
+    /// @brief 完了イベントが届かなかったフリップのバッファ（次のモードセットで表示先が確定してから返却する）
+    struct gbm_bo *stale_bo_ = nullptr;
+    /// @brief 最後にキューしたフリップの通し番号。完了イベントの user_data と照合し、
+    ///        待ちきれずに解除したフリップの遅れて届いたイベントを区別する
+    uint32_t flip_sequence_ = 0;
+    /// @brief drmModePageFlip()が連続して失敗した回数
+    int flip_failures_ = 0;
+    /// @brief drmModeSetCrtc()が失敗し続けているか（失敗し始めた時だけログを出すため）
+    bool modeset_failing_ = false;
+    /// @brief drmHandleEvent()の処理中のインスタンス（完了ハンドラから参照する）
+    static thread_local GraphicsPlatform *event_target_;
+    /// @brief 最初のモードセットが済んでいるか（PageFlipはモードセット後にのみ使える）
+    bool crtc_configured_ = false;
+    /// @brief フレームバッファIDキャッシュの統計
+    FramebufferStats fb_stats_;
+    /// @brief ページフリップの統計
+    FlipStats flip_stats_;
+
+    // --- 表示タイミング ---
+    /// @brief 表示モードの1フレームの長さ
+    std::chrono::nanoseconds refresh_interval_{16666667};
+    /// @brief フリップ完了イベントのタイムスタンプがsteady_clockと同じCLOCK_MONOTONICか
+    bool monotonic_timestamps_ = false;
+    /// @brief 直近のフリップ完了時刻（垂直同期の時刻）
+    std::chrono::steady_clock::time_point last_flip_time_;
+    /// @brief フリップ完了時刻を受け取ったか
+    bool has_flip_time_ = false;
 };
 
 #endif // GRAPHICS_PLATFORM_H
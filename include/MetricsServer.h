@@ -0,0 +1,90 @@
+/**
+ * @file MetricsServer.h
+ * @brief 再生状態の統計を Prometheus のテキスト形式で提供するメトリクスサーバの宣言
+ */
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include "FrameProfiler.h"
+#include "GStreamerSupport.h"
+#include "GlyphCache.h"
+#include "GraphicsPlatform.h"
+#include "Renderer.h"
+#include "TripleBuffer.h"
+
+/**
+ * @class MetricsServer
+ * @brief Unixドメインソケットまたはループバックの TCP ポートで HTTP の GET に応え、統計を Prometheus 形式で返す。
+ * 応答はサーバ専用のスレッドで組み立てるので、遅いスクレイパーが描画ループを待たせることはない。
+ * 描画スレッドは1秒に1回 publish() で統計を TripleBuffer に書き込むだけで、段階毎の処理時間は
+ * FrameProfiler のヒストグラム（atomic なカウンタ）をサーバスレッドが直接読む。
+ */
+class MetricsServer
+{
+public:
+    /**
+     * @brief 描画スレッドから渡す統計
+     */
+    struct RenderStats
+    {
+        int fps = 0;                                  ///< 直前の1秒間のフレーム数
+        GStreamerSupport::FrameQueueStats frameQueue; ///< appsink からのフレームキュー
+        GraphicsPlatform::FlipStats flips;            ///< ページフリップ
+        Renderer::TextureRingStats textureRing;       ///< 映像テクスチャリング
+        GlyphCache::Stats glyphCache;                 ///< テロップのグリフキャッシュ
+        size_t videoTextureBytes = 0;                 ///< 映像テクスチャとFBOのGPUメモリ
+        size_t glyphTextureBytes = 0;                 ///< グリフアトラスのGPUメモリ
+    };
+
+    /** @param profiler 段階毎の処理時間を読むプロファイラ（サーバより長く生存すること） */
+    explicit MetricsServer(FrameProfiler &profiler);
+    ~MetricsServer();
+
+    /**
+     * @brief Unixドメインソケット（SOCK_STREAM）で待ち受ける（例: curl --unix-socket <path> http://localhost/metrics）。
+     * @param path ソケットのパス（既存のファイルは置き換える）
+     * @return 待ち受けを開始できた場合はtrue
+     */
+    bool startSocket(const std::string &path);
+
+    /**
+     * @brief 127.0.0.1 の TCP ポートで待ち受ける。
+     * @param port ポート番号
+     * @return 待ち受けを開始できた場合はtrue
+     */
+    bool startTcp(int port);
+
+    /** @brief 待ち受けを止め、スレッドを終了する。 */
+    void stop();
+
+    /** @brief 待ち受け中か。 @return 待ち受け中ならtrue */
+    bool isRunning() const;
+
+    /** @brief 次に公開する統計の書き込み先を取得する（描画スレッド側）。 @return 書き込み先 */
+    RenderStats &stats() { return stats_.back(); }
+
+    /** @brief stats() に書き込んだ統計を公開する（描画スレッド側）。 */
+    void publish() { stats_.publish(); }
+
+private:
+    bool startWorker();
+    void serveLoop();
+    void handleClient(int clientFd);
+    void formatMetrics(std::string &out);
+
+    FrameProfiler &profiler_;
+    TripleBuffer<RenderStats> stats_;
+    std::chrono::steady_clock::time_point startTime_;
+
+    std::thread thread_;
+    std::atomic<bool> stopping_{false};
+    int listenFd_ = -1;
+    int wakeFd_ = -1;
+    std::string socketPath_; // Unixドメインソケットの場合のみ。終了時に削除する
+};
+
+#endif // METRICS_SERVER_H
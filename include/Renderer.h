@@ -1,20 +1,57 @@
 #pragma once
 
 #include <GLES2/gl2.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include <vector>
+#include <cstddef>
 #include <cstdint>
 
+class GLStateCache;
+
 class Renderer
 {
 public:
+    // 映像フレームの1プレーン分の画素データ
+    struct VideoPlane
+    {
+        const uint8_t *data = nullptr;
+        int stride = 0; // 1行あたりのバイト数（パディング込み）
+    };
+
+    // 映像テクスチャリングの統計
+    struct TextureRingStats
+    {
+        uint64_t uploads = 0;   // アップロードしたフレーム数
+        uint64_t exhausted = 0; // 空きセットが無く、GPUの完了を待ったフレーム数
+        double waitMs = 0.0;    // GPUの完了待ちに費やした累計時間（ミリ秒）
+    };
+
+    // 映像とテロップの合成先
+    enum class CompositionMode
+    {
+        Direct,    // EGLサーフェス(バックバッファ)へ直接描画し、キャプチャするフレームだけFBOを経由する
+        Offscreen, // 常にFBOへ描画してから画面へコピーする（従来方式）
+    };
+
     Renderer();
     ~Renderer();
 
-    bool initialize(int width, int height);
+    void setTextureRingSize(int count); // 映像テクスチャセットの数（initialize()より前に呼ぶ）
+    TextureRingStats getTextureRingStats() const;
+    size_t getTextureBytes() const; // 映像テクスチャとFBOが確保しているGPUメモリ
+
+    bool initialize(int width, int height, GLStateCache &glState);
     void shutdown();
 
-    void uploadYUVTextures(const uint8_t *data, int width, int height, int ySize, int uSize);
-    void renderYUV(int screenWidth, int screenHeight);
+    void uploadYUVTextures(const VideoPlane planes[3], int width, int height);  // Y, U, V
+    void uploadNV12Textures(const VideoPlane planes[2], int width, int height); // Y + UVインターリーブ
+    void renderYUV(int screenWidth, int screenHeight);                              // 最後にアップロードした形式で描画
+
+    void setCompositionMode(CompositionMode mode);
+    CompositionMode getCompositionMode() const;
+    bool beginFrame(bool needCapture, int screenWidth, int screenHeight); // 合成開始。FBOを使う場合はtrue
+    void endFrame(int screenWidth, int screenHeight);                    // 合成終了。FBOを使った場合は画面へコピー
 
     void renderToFBO();                                                                   // FBO に描画開始
     void endOffscreenRender();                                                            // FBO描画終了
@@ -22,18 +59,83 @@ public:
     bool readPixelsFromFBO(std::vector<unsigned char> &outPixels, int width, int height); // PNG保存用
 
 private:
+    enum class VideoFormat
+    {
+        I420,
+        NV12,
+    };
+
     int fboWidth_ = 0;
     int fboHeight_ = 0;
 
-    GLuint yTex_ = 0;
-    GLuint uTex_ = 0;
-    GLuint vTex_ = 0;
+    // 映像プレーン用テクスチャ。ストレージは解像度・形式が変わった時だけ確保し直す
+    struct PlaneTexture
+    {
+        GLuint id = 0;
+        GLenum format = 0; // 確保済みストレージの形式（0 は未確保）
+        int width = 0;     // 確保済みストレージの幅
+        int height = 0;    // 確保済みストレージの高さ
+    };
+
+    // 映像フレーム1枚分のテクスチャ一式。GPUが参照中のセットを上書きしないようリングで使い回す
+    struct VideoTextureSet
+    {
+        PlaneTexture y;
+        PlaneTexture u;
+        PlaneTexture v;
+        PlaneTexture uv; // NV12 の UV プレーン (GL_LUMINANCE_ALPHA)
+        VideoFormat format = VideoFormat::I420;
+        // パディング込みでアップロードしたテクスチャのうち、実画像が占めるUV範囲
+        float lumaTexScale = 1.0f;
+        float chromaTexScale = 1.0f;
+        EGLSyncKHR fence = EGL_NO_SYNC_KHR; // このセットを参照した最後の描画の完了を示すフェンス
+    };
+
+    std::vector<VideoTextureSet> textureSets_;
+    int textureRingSize_ = 3;
+    int currentSet_ = 0; // 最後にアップロードしたセット（renderYUVで描画する）
+    TextureRingStats ringStats_;
+
+    GLStateCache *glState_ = nullptr; // TelopRenderer と共有するGLステートキャッシュ
+
     GLuint yuvProgram_ = 0;
+    GLuint nv12Program_ = 0;
+
+    // 毎フレーム問い合わせないよう、初期化時に取得しておくuniform/attributeの位置
+    struct VideoProgramLocations
+    {
+        GLint texY = -1;
+        GLint texC0 = -1; // I420: texU, NV12: texUV
+        GLint texC1 = -1; // I420: texV
+        GLint texScaleY = -1;
+        GLint texScaleC = -1;
+        GLint position = -1;
+    };
+    VideoProgramLocations yuvLocs_;
+    VideoProgramLocations nv12Locs_;
+    bool hasUnpackSubimage_ = false; // GL_EXT_unpack_subimage が使えるか
+
+    // EGL_KHR_fence_sync
+    EGLDisplay eglDisplay_ = EGL_NO_DISPLAY;
+    PFNEGLCREATESYNCKHRPROC eglCreateSyncKHR_ = nullptr;
+    PFNEGLDESTROYSYNCKHRPROC eglDestroySyncKHR_ = nullptr;
+    PFNEGLCLIENTWAITSYNCKHRPROC eglClientWaitSyncKHR_ = nullptr;
+
+    VideoTextureSet &acquireTextureSet();
+    bool isTextureSetIdle(VideoTextureSet &set);
+    void destroyFence(VideoTextureSet &set);
+    float uploadPlane(PlaneTexture &texture, GLenum format, int bytesPerPixel,
+                      const VideoPlane &plane, int width, int height);
+    void deletePlaneTexture(PlaneTexture &texture);
+
+    CompositionMode compositionMode_ = CompositionMode::Direct;
+    bool frameUsesFBO_ = false; // 現在のフレームをFBOへ合成しているか
 
     GLuint fbo_ = 0;
     GLuint fboTexture_ = 0;
     GLuint fboRenderProgram_ = 0;
-    GLuint fboRenderTextureLoc_ = 0;
+    GLint fboRenderTextureLoc_ = -1;
+    GLint fboRenderPositionLoc_ = -1;
 
     GLuint fullScreenQuadVBO_ = 0;
 };
@@ -1,6 +1,10 @@
 #pragma once
 #include <GLES2/gl2.h>
+#include <string>
 
 GLuint createShader(GLenum type, const char *source);
 GLuint createProgram(const char *vertexSource, const char *fragmentSource);
 GLuint createProgramFromFiles(const char *vertexPath, const char *fragmentPath);
+
+// シェーダファイルのフルパスを返す（RASPI_GL_SHADER_DIR 環境変数でディレクトリを変更可能）
+std::string getShaderPath(const char *fileName);
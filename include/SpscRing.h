@@ -0,0 +1,91 @@
+/**
+ * @file SpscRing.h
+ * @brief 単一プロデューサ・単一コンシューマ用のロックフリーなリングバッファ
+ */
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * @class SpscRing
+ * @brief 固定容量のロックフリーなリングバッファ。
+ * @tparam T 要素の型（ムーブ可能であること）
+ * @note push()は1つのスレッドからのみ、pop()は別の1つのスレッドからのみ呼び出すこと。
+ *       reset()はどちらのスレッドも動作していない時にのみ呼び出すこと。
+ */
+template <typename T>
+class SpscRing
+{
+public:
+    /**
+     * @brief コンストラクタ
+     * @param capacity 格納できる要素数
+     */
+    explicit SpscRing(size_t capacity = 1) { reset(capacity); }
+
+    /**
+     * @brief 容量を変更し、中身を空にする。
+     * @param capacity 格納できる要素数（0の場合は1として扱う）
+     */
+    void reset(size_t capacity)
+    {
+        slots_.clear();
+        slots_.resize(capacity > 0 ? capacity : 1);
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 要素を追加する（プロデューサ側）。
+     * @param item 追加する要素
+     * @return 追加できた場合はtrue、満杯の場合はfalse（itemは変更されない）。
+     */
+    bool push(T &&item)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        if (head - tail >= slots_.size())
+            return false;
+        slots_[head % slots_.size()] = std::move(item);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief 先頭の要素を取り出す（コンシューマ側）。
+     * @param out 取り出した要素の格納先
+     * @return 取り出せた場合はtrue、空の場合はfalse。
+     */
+    bool pop(T &out)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t head = head_.load(std::memory_order_acquire);
+        if (head == tail)
+            return false;
+        out = std::move(slots_[tail % slots_.size()]);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** @brief 現在の要素数を取得する（他スレッドから見た概算値）。 @return 要素数 */
+    size_t size() const
+    {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    /** @brief 容量を取得する。 @return 格納できる要素数 */
+    size_t capacity() const { return slots_.size(); }
+
+private:
+    std::vector<T> slots_;
+    /// @brief 次に書き込む位置（プロデューサのみが更新）
+    alignas(64) std::atomic<size_t> head_{0};
+    /// @brief 次に読み出す位置（コンシューマのみが更新）
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+#endif // SPSC_RING_H
@@ -1,27 +1,74 @@
 #pragma once
 
 #include <string>
-#include <map>
-#include <ft2build.h>
-#include FT_FREETYPE_H
+#include <unordered_set>
+#include <deque>
+#include <vector>
 #include <GLES2/gl2.h>
+#include <atomic>
 #include <chrono>
+#include "GlyphAtlas.h"
+#include "GlyphCache.h"
+#include "GlyphCacheFile.h"
+#include "GlyphRasterizer.h"
+#include "SpscRing.h"
+#include "TextFeed.h"
+
+class GLStateCache;
 
 class TelopRenderer
 {
 public:
+    // グリフの生成方式
+    enum class GlyphMode
+    {
+        Bitmap, // フォントサイズでラスタライズしたα画像。アウトラインは近傍9タップで描く（従来方式）
+        SDF,    // 基準サイズで1度だけ生成した符号付き距離場。任意のサイズとアウトラインを1タップで描く
+    };
+
+    // テロップのスクロール方式
+    enum class ScrollMode
+    {
+        Glyphs, // 毎フレーム、見えているグリフを並べて描く
+        Strip,  // テキスト変更時に1行全体をストリップテクスチャへ描いておき、毎フレームはその四角形を動かすだけにする
+    };
+
     TelopRenderer();
     ~TelopRenderer();
 
     void setupDefaultUniforms(); // 初期設定関数
-    bool initialize(const char *fontPath);
+    void setGlyphMode(GlyphMode mode);   // initialize()より前に呼ぶ
+    void setScrollMode(ScrollMode mode); // initialize()より前に呼ぶ
+    void setGlyphWorkers(int count);     // グリフをラスタライズするワーカースレッド数（initialize()より前に呼ぶ）
+    void setGlyphUploadBudget(int count); // 1フレームにアトラスへアップロードするグリフ数の上限
+    int addFont(const char *fontPath);    // 追加のフォントを登録し、その番号を返す（initialize()より前に呼ぶ）
+    void setFontFace(int face);           // 使うフォントの番号（0 は initialize() に渡したフォント）
+    bool initialize(const char *fontPath, GLStateCache &glState);
+    void setScreenSize(int width, int height); // 描画先の解像度（既定は1280x720）
     void update();
+    // presentTime: このフレームが画面に表示される予測時刻。スクロール位置はこの時刻から（サブピクセル単位で）求める
+    void update(std::chrono::steady_clock::time_point presentTime);
+    // 表示の1フレームの長さ。スクロールのジッター（1フレームの移動量と理想値の差）の基準にする
+    void setRefreshInterval(std::chrono::nanoseconds interval);
     void render();
 
-    // ★ テキスト更新用メソッド
+    // ★ テキスト更新用メソッド（レーン0）
     void SetText(const std::string &text);
-    // ★ フォントサイズを設定
+    // ★ フォントサイズを設定（レーン0）
     void SetFontSize(int size);
+
+    // レーン: テキスト・位置・サイズ・色・スクロール速度を個別に持つ1行。全レーンを1回のパスでまとめて描く
+    // レーン0は画面下端を 100px/s で流れるティッカーとして最初から存在する
+    int addLane();                                       // 新しいレーンを追加し、その番号を返す（既定は左上に静止した白文字）
+    int getLaneCount() const;
+    void setLaneText(int lane, const std::string &text);
+    void setLanePosition(int lane, float x, float baselineY); // スクロールするレーンでは x は使わず、画面右端から流す
+    void setLaneFontSize(int lane, int size);
+    void setLaneColor(int lane, float r, float g, float b, float a);
+    void setLaneScrollSpeed(int lane, float pixelsPerSecond); // 0 なら x の位置に静止させる
+    // 別スレッドのテキストフィードを接続する。update() の度に新しい文字列があれば lane のテキストにする（nullptr で解除）
+    // グリフの並びはフィードのスレッドで組むので、フィードを開始する前に接続すること
+    void attachTextFeed(TextFeed *feed, int lane = 0);
     // ★ 追加：アウトライン設定用メソッド
     void setOutline(bool enabled);
     // アウトライン色を設定（RGBA 各値 0.0〜1.0）
@@ -31,19 +78,29 @@ public:
 
     void setMarginSize(float size);
 
-private:
-    struct Glyph
+    // グリフキャッシュ（アトラス）が使うGPUメモリの上限。超える場合は最も長く使われていないグリフを追い出す
+    void setGlyphCacheBudget(size_t bytes); // initialize()より前に呼ぶ
+    GlyphCache::Stats getGlyphCacheStats() const;
+    size_t getGlyphCacheBytes() const; // アトラスが現在使っているGPUメモリ
+    // ラスタライズ済みのアトラスを保存するファイル。initialize() で読み込み、次回の起動で FreeType を使わずに済ませる
+    void setGlyphCacheFile(const std::string &path); // initialize()より前に呼ぶ
+    bool saveGlyphCacheFile() const;                 // 現在のアトラスをファイルに保存する
+    bool hasPendingText() const;                     // グリフが揃うのを待っている文字列があるか
+
+    // スクロールするレーンの1フレームの移動量と、速度×リフレッシュ間隔の理想値との差（ピクセル）
+    struct ScrollJitterStats
     {
-        GLuint textureID;
-        int width;
-        int height;
-        int bearingX;
-        int bearingY;
-        int advance;
+        uint64_t frames = 0;      // 集計したフレーム数（レーン毎に数える）
+        double meanErrorPx = 0.0; // 差の絶対値の平均
+        double maxErrorPx = 0.0;  // 差の絶対値の最大
     };
+    ScrollJitterStats getScrollJitterStats() const;
+    void resetScrollJitterStats();
 
-    FT_Library library_;
-    FT_Face face_;
+private:
+    using Glyph = GlyphCache::Glyph;
+
+    GLStateCache *glState_ = nullptr; // Renderer と共有するGLステートキャッシュ
 
     GLuint telopProgram_;
     GLint attrPosition_;
@@ -54,17 +111,20 @@ private:
     GLint uniformTextureSize_;
     GLint uniformEnableOutline_; // アウトライン有効化フラグ
     GLint uniformMarginSize_;    // マージン制御用 uniform
-    GLint uniformTextColor_;
+    GLint attrColor_ = -1;      // 文字色（レーン毎に異なるので頂点に持たせる）
+    GLint attrGlyphScale_ = -1; // グリフの拡大率（SDFのぼかし幅とアウトライン幅の換算に使う）
     GLint uniformOutlinePixelWidth_;
+    GLint uniformSdfSpread_ = -1; // SDF: 距離場の範囲（ピクセル）
 
     GLuint vbo_;
 
-    std::wstring text_;
-    std::string currentText_;
-    std::map<wchar_t, Glyph> glyphCache_;
+    GlyphCache glyphCache_;
+    GlyphAtlas atlas_; // 全グリフを格納するテクスチャアトラス
+
+    // 描画バッチ。ページ毎に頂点を集め、連結して1回でVBOへ転送する（毎フレーム再利用）
+    std::vector<std::vector<float>> pageVertices_;
+    std::vector<float> batchVertices_;
 
-    float scrollX_;
-    std::chrono::steady_clock::time_point startTime_;
     int screenWidth_;
     int screenHeight_;
 
@@ -75,8 +135,127 @@ private:
     bool outlineEnabled_ = true;
     float marginSize_ = 0.0f; // マージンのピクセルサイズ
 
-    bool loadGlyph(wchar_t c);
-    void renderGlyph(const Glyph &glyph, float x, float y, float alpha);
+    GlyphMode glyphMode_ = GlyphMode::Bitmap;
+
+    // ストリップ方式: GL_MAX_TEXTURE_SIZE を超える長さの行は、横に並べた複数のタイルに分けて持つ
+    struct StripTile
+    {
+        GLuint texture = 0;
+        int width = 0;
+    };
+    ScrollMode scrollMode_ = ScrollMode::Glyphs;
+    GLuint stripProgram_ = 0;
+    GLint stripAttrPosition_ = -1;
+    GLint stripAttrTexCoord_ = -1;
+    GLint stripUniformResolution_ = -1;
+    GLint stripUniformTexture_ = -1;
+    GLuint stripFbo_ = 0;
+    std::vector<GLuint> stripVisibleTiles_;
+
+    // ラスタライズはワーカーで行い、描画スレッドはアトラスへのアップロードだけを行う
+    GlyphRasterizer rasterizer_;
+    int glyphWorkers_ = 2;
+    int uploadBudget_ = 32;
+    std::unordered_set<GlyphCache::Key> requestedGlyphs_; // ラスタライズを依頼中のグリフ
+    std::unordered_set<GlyphCache::Key> failedGlyphs_;    // ラスタライズできなかったグリフ（描画時は読み飛ばす）
+    size_t glyphCacheBudget_ = 16 * 1024 * 1024;
+    std::string glyphCacheFile_;
+    GlyphCacheFile::Identity glyphCacheIdentity_;
+    std::unordered_set<GlyphCache::Key> pinnedGlyphs_; // 表示中・表示待ちの文字列で使うため追い出さないグリフ
+    bool pinnedGlyphsDirty_ = true; // 文字列が変わり、追い出す時に pinnedGlyphs_ を作り直す必要がある
+    std::deque<GlyphRasterizer::Result> readyGlyphs_; // ラスタライズ済みでアップロード待ちのグリフ
+
+    // グリフの見た目を決める要素。同じ文字でもスタイル毎に別のグリフとしてキャッシュする
+    struct GlyphStyle
+    {
+        int face = 0;
+        int pixelSize = 0;
+        int padding = 0; // アウトライン幅（SDFでは距離場の範囲）から決まる余白
+        bool sdf = false;
+        bool operator==(const GlyphStyle &other) const
+        {
+            return face == other.face && pixelSize == other.pixelSize && padding == other.padding && sdf == other.sdf;
+        }
+    };
+    std::vector<std::string> extraFontPaths_;
+    int fontFace_ = 0;
+
+    struct Lane
+    {
+        std::string currentText;
+        std::wstring text;        // 表示中の文字列
+        std::wstring pendingText; // 全グリフが揃い次第 text と入れ替える文字列
+        std::vector<GlyphCache::Key> pendingKeys; // pendingText の各文字のグリフのキー
+        std::vector<uint8_t> pendingFlags;        // 各グリフの依頼状況（kFeedGlyph*）
+        uint64_t pendingGeneration = 0;           // フィードがレイアウトを組んだ時点の feedGeneration_
+        bool pendingFromFeed = false;             // pendingText がフィードから届いたものか
+        bool textPending = false;
+        GlyphStyle textStyle;    // text のグリフのスタイル
+        GlyphStyle pendingStyle; // pendingText のグリフのスタイル
+        int fontPixelSize = 64;  // 表示するフォントサイズ（SDFでは距離場を拡大縮小して合わせる）
+        float color[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+        float x = 0.0f;
+        float baselineY = 0.0f;
+        float speed = 0.0f;       // スクロール速度（px/s）。0 なら静止
+        float lineAdvance = 0.0f; // 文字列全体の送り幅（ラスタライズ時のピクセル単位）
+        float penX = 0.0f;        // このフレームで描き始める位置
+        float previousPenX = 0.0f; // 前のフレームの位置（ジッターの集計用）
+        bool hasPreviousPenX = false;
+        std::chrono::steady_clock::time_point startTime;
+
+        std::vector<StripTile> stripTiles;
+        int stripHeight = 0;
+        float stripOriginX = 0.0f;  // ストリップ内でのペンの開始位置
+        float stripBaseline = 0.0f; // ストリップ上端からベースラインまで
+        bool stripDirty = true;     // テキストや装飾が変わり、ストリップを描き直す必要がある
+    };
+    std::vector<Lane> lanes_;
+
+    std::chrono::nanoseconds refreshInterval_{16666667};
+    uint64_t jitterFrames_ = 0;
+    double jitterErrorSum_ = 0.0;
+    double jitterErrorMax_ = 0.0;
+
+    // テキストフィード。グリフの並びとラスタライズの依頼はフィードのスレッドで済ませ、描画スレッドは
+    // レイアウトを入れ替えてグリフが揃ったかを確かめるだけにする
+    TextFeed *textFeed_ = nullptr;
+    int textFeedLane_ = 0;
+    TextFeed::Layout feedLayout_;          // フィードと入れ替えるレイアウト（領域を使い回す）
+    std::atomic<uint64_t> feedStyle_{0};   // フィードのレーンのスタイル（glyphKey(style, 0)）。描画スレッドが更新する
+    std::atomic<uint64_t> feedGeneration_{0}; // 描画スレッドがグリフを追い出す（フィードに忘れさせる）度に増やす
+    std::atomic<bool> feedForgetAll_{false};  // 忘れさせるグリフが多すぎる場合、依頼の記録を全て消させる
+    SpscRing<GlyphCache::Key> feedDroppedGlyphs_{256}; // 追い出した・生成に失敗したグリフ（描画→フィード）
+    std::unordered_set<GlyphCache::Key> feedRequested_; // フィードが依頼済みのグリフ（フィードのスレッドだけが触る）
+
+    Lane *findLane(int lane);
+    float getGlyphScale(const Lane &lane) const;
+    GlyphStyle currentStyle(const Lane &lane) const;
+    static GlyphCache::Key glyphKey(const GlyphStyle &style, wchar_t c);
+    void restyleText();
+    void markStripsDirty();
+    static GlyphStyle styleFromKey(GlyphCache::Key key);
+    static GlyphRasterizer::Request makeGlyphRequest(const GlyphStyle &style, wchar_t c);
+    void requestGlyph(const GlyphStyle &style, wchar_t c);
+    void buildFeedLayout(TextFeed::Layout &layout);
+    void forgetFeedGlyph(GlyphCache::Key key);
+    void forgetAllFeedGlyphs();
+    void processRasterizedGlyphs();
+    void uploadGlyph(const GlyphRasterizer::Result &result);
+    void beginPendingText(Lane &lane);
+    void pollTextFeed();
+    bool applyPendingTextIfReady(Lane &lane);
+    void updatePinnedGlyphs();
+    void rebuildPinnedGlyphs();
+    bool makeRoomForGlyph(int width, int height);
+    int findReclaimablePage() const;
+    void beginGlyphBatch(int viewWidth, int viewHeight);
+    void appendLaneGlyphs(const Lane &lane, float penX, float baselineY, int viewWidth);
+    void drawGlyphBatch();
+    bool buildStrip(Lane &lane);
+    void renderStrips();
+    void destroyStripTiles(Lane &lane);
+    void appendGlyphQuad(const Glyph &glyph, float x, float y, float scale, const float color[4],
+                         std::vector<float> &vertices);
 
     void checkGLError(const char *label);
 };
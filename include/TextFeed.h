@@ -0,0 +1,100 @@
+/**
+ * @file TextFeed.h
+ * @brief テロップの文字列を別スレッドで受け取るテキストフィードの宣言
+ */
+#ifndef TEXT_FEED_H
+#define TEXT_FEED_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TripleBuffer.h"
+
+/**
+ * @class TextFeed
+ * @brief Unixドメインソケット、または inotify で監視するファイルから文字列を受け取るワーカースレッド。
+ * 受け取った文字列はワーカー側でワイド文字列へ変換し、setLayoutBuilder() で登録した関数でグリフの並びまで組んでから、
+ * TripleBuffer で描画スレッドへ渡す。描画スレッドはフレームの区切りで poll() を呼び、レイアウトを入れ替えるだけで
+ * 受け取る（ロックもメモリ確保も行わない）。
+ * 描画より速く更新された場合、途中の文字列は読み飛ばして最新のものだけを渡す。
+ */
+class TextFeed
+{
+public:
+    /**
+     * @brief 描画スレッドへ渡す1つの文字列のレイアウト。utf8 と text 以外はレイアウトを組む関数が埋める
+     */
+    struct Layout
+    {
+        std::string utf8;                 ///< 受け取った文字列
+        std::wstring text;                ///< ワイド文字列に変換した文字列
+        uint64_t style = 0;               ///< レイアウトを組んだスタイル
+        std::vector<uint64_t> glyphKeys;  ///< text の各文字のグリフのキー
+        std::vector<uint8_t> glyphFlags;  ///< 各グリフの状態（意味はレイアウトを組む側が決める）
+        uint64_t generation = 0;          ///< レイアウトを組んだ時点の、組む側が参照した状態の世代
+    };
+
+    /// @brief ワーカースレッドで、変換済みの文字列からレイアウトを組む関数
+    using LayoutBuilder = std::function<void(Layout &)>;
+
+    TextFeed();
+    ~TextFeed();
+
+    /**
+     * @brief Unixドメインソケット（SOCK_STREAM）で待ち受ける。接続から受け取った1行を1つの文字列とする。
+     * @param path ソケットのパス（既存のファイルは置き換える）
+     * @return 待ち受けを開始できた場合はtrue
+     */
+    bool startSocket(const std::string &path);
+
+    /**
+     * @brief ファイルを監視し、書き込みが完了する度にその内容を文字列とする（改行は空白に置き換える）。
+     * 一時ファイルへ書いてから rename() で置き換える更新にも対応する。
+     * @param path 監視するファイルのパス
+     * @return 監視を開始できた場合はtrue
+     */
+    bool startFile(const std::string &path);
+
+    /**
+     * @brief レイアウトを組む関数を登録する。start*() より前に呼ぶこと。
+     * @param builder ワーカースレッド（startFile() の初回の読み込みでは呼び出し元のスレッド）から呼ばれる関数
+     */
+    void setLayoutBuilder(LayoutBuilder builder);
+
+    /** @brief ワーカースレッドを停止する。 */
+    void stop();
+
+    /** @brief ワーカーが動作中か。 @return 動作中ならtrue */
+    bool isRunning() const;
+
+    /**
+     * @brief 前回から新しい文字列が届いていれば受け取る（描画スレッドから呼ぶ）。
+     * 引数のレイアウトとバッファ内のレイアウトを swap するので、渡したレイアウトの領域は次の受信で再利用される。
+     * @param layout レイアウトの格納先
+     * @return 新しい文字列を受け取った場合はtrue
+     */
+    bool poll(Layout &layout);
+
+private:
+    bool startWorker();
+    void socketLoop();
+    void fileLoop();
+    void publish(const std::string &utf8);
+    bool readFile();
+
+    std::thread thread_;
+    std::atomic<bool> stopping_{false};
+    int wakeFd_ = -1;   // stop() でワーカーの poll() を起こす eventfd
+    int listenFd_ = -1; // ソケットモードの待ち受け
+    int inotifyFd_ = -1;
+    int watchFd_ = -1;
+    std::string path_;
+    std::string fileName_; // ファイルモードで監視するファイル名（ディレクトリを除く）
+    LayoutBuilder layoutBuilder_;
+    TripleBuffer<Layout> buffer_;
+};
+
+#endif // TEXT_FEED_H
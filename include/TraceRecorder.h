@@ -0,0 +1,192 @@
+/**
+ * @file TraceRecorder.h
+ * @brief 描画ループ・映像取り込み・ページフリップのイベントを記録し、Chromeトレース形式で出力するレコーダの宣言
+ */
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class TraceRecorder
+ * @brief イベントをスレッド毎のリングバッファに記録し、Chromeトレース形式(JSON)のファイルに書き出す。
+ * バッファは start() で決めた件数を最初の記録時に確保し、以降は古いイベントを上書きするので、
+ * 記録のコストはバッファへの書き込み1回で一定になる。ロックはスレッドの初回登録時だけ取る。
+ * SIGUSR1 を受けると dumpIfRequested() が書き出し用のスレッドに依頼し、JSONの整形とファイルへの書き込みは
+ * そのスレッドで行う（描画ループを止めない）。stop() でも書き出す。chrome://tracing や Perfetto で開ける。
+ * @note 計測点は TRACE_* マクロで記述する。CMake の ENABLE_TRACE を OFF にすると、マクロは空になり一切コストがかからない。
+ */
+class TraceRecorder
+{
+public:
+    /**
+     * @brief 記録された1イベント
+     */
+    struct Event
+    {
+        const char *name = nullptr;    ///< イベント名（文字列リテラルなど、プロセス終了まで有効な文字列）
+        const char *argName = nullptr; ///< 引数名（無ければnullptr）
+        int64_t timestampNs = 0;       ///< 開始時刻（steady_clock, ns）
+        int64_t durationNs = 0;        ///< 長さ（ns）。区間イベントのみ
+        int64_t arg = 0;               ///< 引数の値
+        char phase = 0;                ///< Chromeトレースのph（'X' 区間, 'i' 瞬間, 'C' カウンタ）
+    };
+
+    /** @brief プロセスで1つのレコーダを取得する。 @return レコーダ */
+    static TraceRecorder &instance();
+
+    /**
+     * @brief 記録を開始し、SIGUSR1 で書き出すようにする。
+     * @param path 出力ファイルのパス
+     * @param eventsPerThread スレッド毎に保持するイベント数（2のべき乗に切り上げる）
+     * @return 開始できた場合はtrue
+     */
+    bool start(const std::string &path, size_t eventsPerThread = 1 << 16);
+
+    /** @brief 記録を止め、書き出し用のスレッドを終了してから、残っているイベントを書き出す。 */
+    void stop();
+
+    /** @brief 記録中か。 @return 記録中ならtrue */
+    static bool isEnabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 区間イベントを記録する。
+     * @param name イベント名
+     * @param start 開始時刻
+     * @param end 終了時刻
+     */
+    void complete(const char *name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+    /**
+     * @brief 瞬間イベントを記録する。
+     * @param name イベント名
+     * @param argName 引数名（無ければnullptr）
+     * @param arg 引数の値
+     */
+    void instant(const char *name, const char *argName = nullptr, int64_t arg = 0);
+
+    /**
+     * @brief カウンタの値を記録する。
+     * @param name カウンタ名
+     * @param value 値
+     */
+    void counter(const char *name, int64_t value);
+
+    /** @brief 書き出しを依頼する（シグナルハンドラから呼べる）。 */
+    void requestDump();
+
+    /**
+     * @brief 書き出しが依頼されていれば、書き出し用のスレッドに渡す（描画ループから毎フレーム呼ぶ）。
+     * 依頼が無ければ atomic の読み込み1回で戻る。
+     * @return 書き出しを渡した場合はtrue
+     */
+    bool dumpIfRequested();
+
+    /**
+     * @brief 現在バッファに残っているイベントをファイルに書き出す。
+     * @return 書き出せた場合はtrue
+     */
+    bool dump();
+
+    /**
+     * @class Scope
+     * @brief スコープの間を1つの区間イベントとして記録する。
+     */
+    class Scope
+    {
+    public:
+        explicit Scope(const char *name) : name_(name), active_(isEnabled())
+        {
+            if (active_)
+                start_ = std::chrono::steady_clock::now();
+        }
+        ~Scope()
+        {
+            if (active_)
+                instance().complete(name_, start_, std::chrono::steady_clock::now());
+        }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        const char *name_;
+        bool active_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+private:
+    /**
+     * @brief 1スレッド分のリングバッファ。書き込むのはそのスレッドだけ
+     */
+    struct ThreadBuffer
+    {
+        std::vector<Event> events;
+        std::atomic<uint64_t> head{0}; // これまでに書き込んだ件数
+        int tid = 0;
+        std::string threadName;
+    };
+
+    TraceRecorder() = default;
+    ~TraceRecorder();
+    ThreadBuffer *threadBuffer();
+    void push(const Event &event);
+    void dumpLoop();
+    void stopDumpThread();
+
+    static std::atomic<bool> enabled_;
+
+    std::mutex mutex_; // buffers_ の追加と書き出しを守る
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+    std::string path_;
+    size_t eventsPerThread_ = 0;
+    std::atomic<bool> dumpRequested_{false};
+
+    std::thread dumpThread_;
+    std::mutex dumpMutex_; // 以下の2つを守る
+    std::condition_variable dumpCondition_;
+    bool dumpPending_ = false;
+    bool dumpStopping_ = false;
+};
+
+#ifdef RASPI_GL_ENABLE_TRACE
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+/// スコープの終わりまでを区間イベントとして記録する
+#define TRACE_SCOPE(name) TraceRecorder::Scope TRACE_CONCAT(traceScope_, __LINE__)(name)
+/// 計測済みの区間を記録する
+#define TRACE_COMPLETE(name, start, end)                         \
+    do                                                           \
+    {                                                            \
+        if (TraceRecorder::isEnabled())                          \
+            TraceRecorder::instance().complete(name, start, end); \
+    } while (0)
+/// 瞬間イベントを1つの引数付きで記録する
+#define TRACE_INSTANT(name, argName, arg)                                          \
+    do                                                                             \
+    {                                                                              \
+        if (TraceRecorder::isEnabled())                                            \
+            TraceRecorder::instance().instant(name, argName, static_cast<int64_t>(arg)); \
+    } while (0)
+/// カウンタの値を記録する
+#define TRACE_COUNTER(name, value)                                               \
+    do                                                                           \
+    {                                                                            \
+        if (TraceRecorder::isEnabled())                                          \
+            TraceRecorder::instance().counter(name, static_cast<int64_t>(value)); \
+    } while (0)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_COMPLETE(name, start, end) ((void)0)
+#define TRACE_INSTANT(name, argName, arg) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+#endif
+
+#endif // TRACE_RECORDER_H
@@ -0,0 +1,59 @@
+/**
+ * @file TripleBuffer.h
+ * @brief 単一プロデューサ・単一コンシューマ用のロックフリーなトリプルバッファ
+ */
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+/**
+ * @class TripleBuffer
+ * @brief 最新の値だけを受け渡す3面バッファ。
+ * プロデューサは back() に書き込んで publish() し、コンシューマは consume() で最新の面を front() として受け取る。
+ * 面の入れ替えは添字の atomic な交換だけで行うので、どちらの側もロックやメモリ確保を行わない。
+ * コンシューマが受け取る前に次の値が publish() された場合、古い値は読まれずに上書きされる。
+ * @tparam T 各面に持つ値の型
+ * @note back()/publish() は1つのスレッドからのみ、consume()/front() は別の1つのスレッドからのみ呼び出すこと。
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+    /** @brief 書き込み中の面を取得する（プロデューサ側）。 @return 書き込み先 */
+    T &back() { return slots_[back_]; }
+
+    /** @brief back() に書き込んだ内容を公開し、空いた面を次の書き込み先にする（プロデューサ側）。 */
+    void publish()
+    {
+        const int previous = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel);
+        back_ = previous & kIndexMask;
+    }
+
+    /**
+     * @brief 公開済みの新しい面があれば front() と入れ替える（コンシューマ側）。
+     * @return 新しい値を受け取った場合はtrue
+     */
+    bool consume()
+    {
+        if (!(middle_.load(std::memory_order_relaxed) & kFresh))
+            return false;
+        const int previous = middle_.exchange(front_, std::memory_order_acq_rel);
+        front_ = previous & kIndexMask;
+        return true;
+    }
+
+    /** @brief 最後に受け取った面を取得する（コンシューマ側）。 @return 受け取った値 */
+    T &front() { return slots_[front_]; }
+
+private:
+    static constexpr int kIndexMask = 0x3;
+    static constexpr int kFresh = 0x4; // middle_ がまだ受け取られていない値を指している
+
+    T slots_[3];
+    int back_ = 0;            // プロデューサだけが触る
+    std::atomic<int> middle_{1};
+    int front_ = 2;           // コンシューマだけが触る
+};
+
+#endif // TRIPLE_BUFFER_H
@@ -3,10 +3,13 @@ precision mediump float;
 varying vec2 v_texCoord;
 uniform sampler2D texY;
 uniform sampler2D texUV;
+// パディング込みでアップロードしたテクスチャから実画像部分を切り取るための倍率
+uniform vec2 texScaleY;
+uniform vec2 texScaleUV;
 
 void main() {
-    float y = texture2D(texY, v_texCoord).r;
-    vec2 uv = texture2D(texUV, v_texCoord).ra;
+    float y = texture2D(texY, v_texCoord * texScaleY).r;
+    vec2 uv = texture2D(texUV, v_texCoord * texScaleUV).ra;
     float u = uv.x - 0.5;
     float v = uv.y - 0.5;
 
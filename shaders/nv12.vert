@@ -1,9 +1,9 @@
 #version 100
-attribute vec4 a_position;
-attribute vec2 a_texCoord;
+attribute vec2 a_position;
 varying vec2 v_texCoord;
 
 void main() {
-    gl_Position = a_position;
-    v_texCoord = a_texCoord;
+    // Renderer の I420 パスと同じく、フルスクリーン矩形の頂点座標からUVを求める
+    v_texCoord = (a_position + 1.0) * 0.5;
+    gl_Position = vec4(a_position, 0.0, 1.0);
 }
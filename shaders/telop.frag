@@ -7,8 +7,7 @@ uniform sampler2D u_texture;
 // テクスチャサイズ（ピクセル単位）
 uniform vec2 u_textureSize;
 
-// テキスト本体とアウトラインの色
-uniform vec4 u_textColor;
+// アウトラインの色（テキスト本体の色は頂点から受け取る）
 uniform vec4 u_outlineColor;
 
 // アウトラインの太さ（ピクセル単位指定）
@@ -23,6 +22,9 @@ uniform float u_marginPixelSize;
 // 頂点シェーダから受け取るUV座標（0.0〜1.0範囲）
 varying vec2 v_texCoord;
 
+// テキスト本体の色（レーン毎）
+varying vec4 v_color;
+
 void main() {
 
     // 中心ピクセルのアルファ値を取得（本体かどうか判定）
@@ -30,7 +32,7 @@ void main() {
 
     if( u_enableOutline == 0)
     {
-        gl_FragColor = vec4(u_textColor.rgb, centerAlpha);
+        gl_FragColor = vec4(v_color.rgb, centerAlpha * v_color.a);
     }
     else
     {
@@ -57,7 +59,7 @@ void main() {
 
         // 描画条件によって色を決定
         if (centerAlpha > 0.0) {
-            vec3 blendedRGB = u_textColor.rgb * centerAlpha + u_outlineColor.rgb * (1.0 - centerAlpha);
+            vec3 blendedRGB = v_color.rgb * centerAlpha + u_outlineColor.rgb * (1.0 - centerAlpha);
             gl_FragColor = vec4(blendedRGB, 1.0);
         } else if (maxAlpha >= 0.0) {
             // 近傍が不透明 → アウトライン領域
@@ -1,6 +1,10 @@
 attribute vec2 a_position;
 attribute vec2 a_texcoord;
+attribute vec4 a_color;      // 文字色（レーン毎）
+attribute float a_glyphScale; // グリフの拡大率（SDFでのみ使う）
 varying vec2 v_texCoord;
+varying vec4 v_color;
+varying float v_glyphScale;
 
 uniform vec2 u_resolution;
 
@@ -9,5 +13,7 @@ void main() {
     vec2 zeroToTwo = zeroToOne * 2.0;
     vec2 clipSpace = zeroToTwo - 1.0;
     gl_Position = vec4(clipSpace * vec2(1, -1), 0, 1);
-    v_texCoord = vec2(a_texcoord.x, 1.0 - a_texcoord.y);  // ← ここでY軸反転
+    v_texCoord = a_texcoord;  // アトラス上のUVをそのまま使う（上下は頂点側で合わせ済み）
+    v_color = a_color;
+    v_glyphScale = a_glyphScale;
 }
@@ -0,0 +1,49 @@
+// 中精度の浮動小数点演算（組込みGPUに適した設定）
+precision mediump float;
+
+// 符号付き距離場のグリフテクスチャ（α = 0.5 が輪郭、内側ほど大きい）
+uniform sampler2D u_texture;
+
+// アウトラインの色（テキスト本体の色は頂点から受け取る）
+uniform vec4 u_outlineColor;
+
+// アウトラインが有効化？
+uniform int u_enableOutline;
+
+// アウトラインの太さ（画面ピクセル単位）
+uniform float u_outlinePixelWidth;
+
+// 距離場が輪郭の内外それぞれに持つ範囲（距離場生成時のピクセル単位）
+uniform float u_sdfSpread;
+
+// 頂点シェーダから受け取るUV座標
+varying vec2 v_texCoord;
+
+// テキスト本体の色と、距離場の拡大率（レーン毎）
+varying vec4 v_color;
+varying float v_glyphScale;
+
+void main() {
+    // 1画面ピクセルが距離場の値でどれだけに当たるかから、輪郭のぼかし幅とアウトライン幅を決める
+    float pixelDistance = 1.0 / (2.0 * u_sdfSpread * v_glyphScale);
+    float smoothing = pixelDistance * 0.7;
+
+    // 1回のサンプルで本体・アウトラインの両方を判定する
+    float distance = texture2D(u_texture, v_texCoord).a;
+    float fill = smoothstep(0.5 - smoothing, 0.5 + smoothing, distance);
+
+    if (u_enableOutline == 0)
+    {
+        gl_FragColor = vec4(v_color.rgb, fill * v_color.a);
+    }
+    else
+    {
+        // 輪郭からアウトライン幅だけ外側までをアウトラインとして塗る
+        float outlineDistance = min(u_outlinePixelWidth * pixelDistance, 0.5 - pixelDistance);
+        float outlineEdge = 0.5 - outlineDistance;
+        float outline = smoothstep(outlineEdge - smoothing, outlineEdge + smoothing, distance);
+        vec3 rgb = mix(u_outlineColor.rgb, v_color.rgb, fill);
+        float alpha = mix(outline * u_outlineColor.a, v_color.a, fill);
+        gl_FragColor = vec4(rgb, alpha);
+    }
+}
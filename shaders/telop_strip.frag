@@ -0,0 +1,12 @@
+// 中精度の浮動小数点演算（組込みGPUに適した設定）
+precision mediump float;
+
+// 事前にテロップ1行を描いておいたストリップテクスチャ（乗算済みアルファ）
+uniform sampler2D u_texture;
+
+// 頂点シェーダから受け取るUV座標
+varying vec2 v_texCoord;
+
+void main() {
+    gl_FragColor = texture2D(u_texture, v_texCoord);
+}
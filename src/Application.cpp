@@ -2,6 +2,7 @@
 #include "GStreamerSupport.h"
 #include "FPSCounter.h"
 #include "TelopRenderer.h"
+#include "TraceRecorder.h"
 #include "Util.h"
 #include <iostream>
 #include <unistd.h>
@@ -12,6 +13,11 @@
 #include <iomanip>
 #include <sstream>
 #include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <thread>
 
 Application::Application() {}
 
@@ -22,41 +28,293 @@ Application::~Application()
     platform_.shutdown();
 }
 
+/// @brief 環境変数を取得する
+/// @param name 環境変数名
+/// @return 値。未設定または空文字の場合はnullptr
+static const char *getEnvOption(const char *name)
+{
+    const char *value = std::getenv(name);
+    return (value && *value) ? value : nullptr;
+}
+
 /// @brief アプリケーションに必要な全てのコンポーネントを初期化する。
 /// @return
 bool Application::initialize()
 {
+    // トレースの記録 (RASPI_GL_TRACE_FILE=<パス>)。映像の取り込みより前に始める
+    if (const char *traceFile = getEnvOption("RASPI_GL_TRACE_FILE"))
+    {
+#ifdef RASPI_GL_ENABLE_TRACE
+        TraceRecorder::instance().start(traceFile);
+#else
+        std::cerr << "RASPI_GL_TRACE_FILE is ignored: " << traceFile << " (build with -DENABLE_TRACE=ON)" << std::endl;
+#endif
+    }
     // GStreamerの初期化
     if (!gstreamer_.initialize())
     {
         std::cerr << "Failed to initialize GStreamerSupport." << std::endl;
         return false;
     }
+    // 描画先のバックエンド (RASPI_GL_BACKEND=drm|headless)
+    if (const char *backend = getEnvOption("RASPI_GL_BACKEND"))
+    {
+        if (std::strcmp(backend, "headless") == 0)
+        {
+            platform_.setBackend(GraphicsPlatform::Backend::Headless);
+        }
+        else if (std::strcmp(backend, "drm") == 0)
+        {
+            platform_.setBackend(GraphicsPlatform::Backend::Drm);
+        }
+        else
+        {
+            std::cerr << "Unknown RASPI_GL_BACKEND: " << backend << " (expected drm or headless)" << std::endl;
+        }
+    }
+    // ヘッドレスバックエンドの解像度とリフレッシュレート (RASPI_GL_HEADLESS_MODE=1920x1080@60)
+    if (const char *headlessMode = getEnvOption("RASPI_GL_HEADLESS_MODE"))
+    {
+        int width = 0;
+        int height = 0;
+        int refreshHz = 60;
+        if (std::sscanf(headlessMode, "%dx%d@%d", &width, &height, &refreshHz) >= 2 && width > 0 && height > 0 &&
+            refreshHz > 0)
+        {
+            platform_.setHeadlessMode(width, height, refreshHz);
+        }
+        else
+        {
+            std::cerr << "Invalid RASPI_GL_HEADLESS_MODE: " << headlessMode << " (expected <width>x<height>[@<Hz>])"
+                      << std::endl;
+        }
+    }
+    // ヘッドレスバックエンドのフレームの書き出し先 (RASPI_GL_FRAME_SINK=/tmp/frames.rgba)
+    platform_.setFrameSink(getEnvOption("RASPI_GL_FRAME_SINK"));
+    // 画面更新方式の選択 (RASPI_GL_PRESENT_MODE=flip|setcrtc)
+    if (const char *mode = getEnvOption("RASPI_GL_PRESENT_MODE"))
+    {
+        if (std::strcmp(mode, "setcrtc") == 0)
+        {
+            platform_.setPresentMode(GraphicsPlatform::PresentMode::SetCrtc);
+        }
+        else if (std::strcmp(mode, "flip") == 0)
+        {
+            platform_.setPresentMode(GraphicsPlatform::PresentMode::PageFlip);
+        }
+        else
+        {
+            std::cerr << "Unknown RASPI_GL_PRESENT_MODE: " << mode << " (expected flip or setcrtc)" << std::endl;
+        }
+    }
+    // DRMデバイスの指定 (例: vkmsでの動作確認用に RASPI_GL_DRM_DEVICE=/dev/dri/card1)
+    platform_.setDrmDevicePath(getEnvOption("RASPI_GL_DRM_DEVICE"));
+
+    // フレームキューの設定 (RASPI_GL_FRAME_QUEUE_DEPTH=4, RASPI_GL_FRAME_QUEUE_POLICY=latest|fifo)
+    size_t queueDepth = 4;
+    GStreamerSupport::FrameQueuePolicy queuePolicy = GStreamerSupport::FrameQueuePolicy::Latest;
+    if (const char *depth = getEnvOption("RASPI_GL_FRAME_QUEUE_DEPTH"))
+    {
+        queueDepth = static_cast<size_t>(std::max(1, std::atoi(depth)));
+    }
+    if (const char *policy = getEnvOption("RASPI_GL_FRAME_QUEUE_POLICY"))
+    {
+        if (std::strcmp(policy, "fifo") == 0)
+        {
+            queuePolicy = GStreamerSupport::FrameQueuePolicy::Fifo;
+        }
+        else if (std::strcmp(policy, "latest") != 0)
+        {
+            std::cerr << "Unknown RASPI_GL_FRAME_QUEUE_POLICY: " << policy << " (expected latest or fifo)" << std::endl;
+        }
+    }
+    gstreamer_.setFrameQueue(queueDepth, queuePolicy);
+    // H.264 のデコーダ要素 (RASPI_GL_VIDEO_DECODER=avdec_h264|v4l2h264dec など)
+    gstreamer_.setVideoDecoder(getEnvOption("RASPI_GL_VIDEO_DECODER"));
+
     // グラフィックスプラットフォームの初期化
     if (!platform_.initialize())
     {
         std::cerr << "Failed to initialize GraphicsPlatform." << std::endl;
         return false;
     }
+    // 映像テクスチャリングのセット数 (RASPI_GL_TEXTURE_RING=3)
+    if (const char *ring = getEnvOption("RASPI_GL_TEXTURE_RING"))
+    {
+        renderer_.setTextureRingSize(std::atoi(ring));
+    }
+
+    // 合成先 (RASPI_GL_COMPOSITION=direct|fbo)
+    if (const char *composition = getEnvOption("RASPI_GL_COMPOSITION"))
+    {
+        if (std::strcmp(composition, "fbo") == 0)
+        {
+            renderer_.setCompositionMode(Renderer::CompositionMode::Offscreen);
+        }
+        else if (std::strcmp(composition, "direct") == 0)
+        {
+            renderer_.setCompositionMode(Renderer::CompositionMode::Direct);
+        }
+        else
+        {
+            std::cerr << "Unknown RASPI_GL_COMPOSITION: " << composition << " (expected direct or fbo)" << std::endl;
+        }
+    }
+
     // レンダラーの初期化
-    if (!renderer_.initialize(platform_.getScreenWidth(), platform_.getScreenHeight()))
+    if (!renderer_.initialize(platform_.getScreenWidth(), platform_.getScreenHeight(), glState_))
     {
         std::cerr << "Failed to initialize Renderer." << std::endl;
         return false;
     }
-    // テロップレンダラーの初期化
-    if (!telopRenderer_.initialize("/usr/share/fonts/truetype/vlgothic/VL-Gothic-Regular.ttf"))
+    // 毎秒の出力に各部の統計と段階毎の処理時間を含める (RASPI_GL_STATS_LOG=1)
+    if (const char *statsLog = getEnvOption("RASPI_GL_STATS_LOG"))
+    {
+        if (std::strcmp(statsLog, "1") == 0)
+        {
+            statsLog_ = true;
+        }
+        else if (std::strcmp(statsLog, "0") != 0)
+        {
+            std::cerr << "Unknown RASPI_GL_STATS_LOG: " << statsLog << " (expected 0 or 1)" << std::endl;
+        }
+    }
+    // GPUの処理時間も段階毎に計測する (RASPI_GL_GPU_TIMERS=1)
+    if (const char *gpuTimers = getEnvOption("RASPI_GL_GPU_TIMERS"))
+    {
+        if (std::strcmp(gpuTimers, "1") == 0)
+        {
+            profiler_.enableGpuTimers();
+        }
+        else if (std::strcmp(gpuTimers, "0") != 0)
+        {
+            std::cerr << "Unknown RASPI_GL_GPU_TIMERS: " << gpuTimers << " (expected 0 or 1)" << std::endl;
+        }
+    }
+    // テロップのグリフ生成方式 (RASPI_GL_TELOP_GLYPH=bitmap|sdf)
+    if (const char *glyph = getEnvOption("RASPI_GL_TELOP_GLYPH"))
+    {
+        if (std::strcmp(glyph, "sdf") == 0)
+        {
+            telopRenderer_.setGlyphMode(TelopRenderer::GlyphMode::SDF);
+        }
+        else if (std::strcmp(glyph, "bitmap") == 0)
+        {
+            telopRenderer_.setGlyphMode(TelopRenderer::GlyphMode::Bitmap);
+        }
+        else
+        {
+            std::cerr << "Unknown RASPI_GL_TELOP_GLYPH: " << glyph << " (expected bitmap or sdf)" << std::endl;
+        }
+    }
+    // テロップのスクロール方式 (RASPI_GL_TELOP_SCROLL=glyphs|strip)
+    if (const char *scroll = getEnvOption("RASPI_GL_TELOP_SCROLL"))
+    {
+        if (std::strcmp(scroll, "strip") == 0)
+        {
+            telopRenderer_.setScrollMode(TelopRenderer::ScrollMode::Strip);
+        }
+        else if (std::strcmp(scroll, "glyphs") == 0)
+        {
+            telopRenderer_.setScrollMode(TelopRenderer::ScrollMode::Glyphs);
+        }
+        else
+        {
+            std::cerr << "Unknown RASPI_GL_TELOP_SCROLL: " << scroll << " (expected glyphs or strip)" << std::endl;
+        }
+    }
+    // グリフのラスタライズを行うワーカー数と、1フレームのアップロード上限
+    // (RASPI_GL_GLYPH_WORKERS=2, RASPI_GL_GLYPH_UPLOAD_BUDGET=32)
+    if (const char *workers = getEnvOption("RASPI_GL_GLYPH_WORKERS"))
+    {
+        telopRenderer_.setGlyphWorkers(std::atoi(workers));
+    }
+    if (const char *budget = getEnvOption("RASPI_GL_GLYPH_UPLOAD_BUDGET"))
+    {
+        telopRenderer_.setGlyphUploadBudget(std::atoi(budget));
+    }
+    // グリフキャッシュのGPUメモリ上限 (RASPI_GL_GLYPH_CACHE_MB=16)
+    if (const char *cacheMb = getEnvOption("RASPI_GL_GLYPH_CACHE_MB"))
+    {
+        telopRenderer_.setGlyphCacheBudget(static_cast<size_t>(std::max(1, std::atoi(cacheMb))) * 1024 * 1024);
+    }
+    // ラスタライズ済みアトラスの保存先 (RASPI_GL_GLYPH_CACHE_FILE=/var/cache/raspi_gl/glyphs.bin)
+    if (const char *cacheFile = getEnvOption("RASPI_GL_GLYPH_CACHE_FILE"))
+    {
+        telopRenderer_.setGlyphCacheFile(cacheFile);
+    }
+    // テロップレンダラーの初期化（起動から最初のテキストが表示できるまでの時間を測る）
+    telopStartTime_ = std::chrono::steady_clock::now();
+    telopRenderer_.setScreenSize(platform_.getScreenWidth(), platform_.getScreenHeight());
+    telopRenderer_.setRefreshInterval(platform_.getRefreshInterval());
+    if (!telopRenderer_.initialize("/usr/share/fonts/truetype/vlgothic/VL-Gothic-Regular.ttf", glState_))
     {
         std::cerr << "Failed to initialize TelopRenderer" << std::endl;
         return false;
     }
 
     // 初期テキストの設定
+    // グリフはスタイル（サイズ・アウトライン幅）毎に生成されるので、スタイルを先に決めてからテキストを渡す
     telopRenderer_.SetFontSize(64); // フォントサイズを設定
-    telopRenderer_.SetText("こんにちは、世界！テロップのテスト中です・・・・・いかがでしょうか？〇(^^♪〇");
     telopRenderer_.setOutline(true);
     telopRenderer_.setOutlineColor(0.0f, 0.0f, 0.0f, 0.8f);
     telopRenderer_.setOutlinePixelWidth(4.0f);
+    telopRenderer_.SetText("こんにちは、世界！テロップのテスト中です・・・・・いかがでしょうか？〇(^^♪〇");
+
+    // 右上に静止した時計 (RASPI_GL_TELOP_CLOCK=1)。ティッカーと同じパスでまとめて描かれる
+    if (const char *clock = getEnvOption("RASPI_GL_TELOP_CLOCK"))
+    {
+        if (std::strcmp(clock, "1") == 0)
+        {
+            clockLane_ = telopRenderer_.addLane();
+            telopRenderer_.setLaneFontSize(clockLane_, 40);
+            telopRenderer_.setLaneColor(clockLane_, 1.0f, 0.9f, 0.3f, 1.0f);
+            telopRenderer_.setLanePosition(clockLane_, platform_.getScreenWidth() - 200.0f, 56.0f);
+        }
+        else if (std::strcmp(clock, "0") != 0)
+        {
+            std::cerr << "Unknown RASPI_GL_TELOP_CLOCK: " << clock << " (expected 0 or 1)" << std::endl;
+        }
+    }
+
+    // ティッカーの文字列を外部から更新するフィード (RASPI_GL_TELOP_FEED=unix:/tmp/telop.sock|file:/path/to/text)
+    if (const char *feed = getEnvOption("RASPI_GL_TELOP_FEED"))
+    {
+        // フィードのスレッドがグリフの並びを組めるよう、開始する前に接続する
+        telopRenderer_.attachTextFeed(&textFeed_, 0);
+        bool started = false;
+        if (std::strncmp(feed, "unix:", 5) == 0)
+        {
+            started = textFeed_.startSocket(feed + 5);
+        }
+        else if (std::strncmp(feed, "file:", 5) == 0)
+        {
+            started = textFeed_.startFile(feed + 5);
+        }
+        else
+        {
+            std::cerr << "Unknown RASPI_GL_TELOP_FEED: " << feed << " (expected unix:<path> or file:<path>)" << std::endl;
+        }
+        if (!started)
+            telopRenderer_.attachTextFeed(nullptr);
+    }
+
+    // 監視用のメトリクス (RASPI_GL_METRICS=unix:/tmp/raspi_gl.sock|tcp:9100)
+    if (const char *metrics = getEnvOption("RASPI_GL_METRICS"))
+    {
+        if (std::strncmp(metrics, "unix:", 5) == 0)
+        {
+            metrics_.startSocket(metrics + 5);
+        }
+        else if (std::strncmp(metrics, "tcp:", 4) == 0)
+        {
+            metrics_.startTcp(std::atoi(metrics + 4));
+        }
+        else
+        {
+            std::cerr << "Unknown RASPI_GL_METRICS: " << metrics << " (expected unix:<path> or tcp:<port>)" << std::endl;
+        }
+    }
 
     return true;
 }
@@ -104,6 +362,7 @@ bool Application::run()
     std::cout << "[App] Waiting for first frame..." << std::endl;
 
     GStreamerSupport::FrameData frame;
+    bool hasFrame = false;
     int retries = 300;
     // 3秒間、フレームが取得できるのを待つ
     while (retries-- > 0)
@@ -111,12 +370,13 @@ bool Application::run()
         if (gstreamer_.getFrameData(frame))
         {
             std::cout << "[App] First frame received." << std::endl;
+            hasFrame = true;
             break;
         }
         usleep(10000);
     }
 
-    if (retries <= 0)
+    if (!hasFrame)
     {
         std::cerr << "[App] Timeout waiting for first frame." << std::endl;
         return false;
@@ -149,65 +409,181 @@ bool Application::run()
             break;
         }
 
-        if (gstreamer_.getFrameData(frame))
+        // 新しいフレームがあればテクスチャを更新する（ブロックしない）
+        const auto frameStart = std::chrono::steady_clock::now();
+        const bool newFrame = hasFrame || gstreamer_.getFrameData(frame);
+        if (!newFrame && platform_.getPresentMode() != GraphicsPlatform::PresentMode::PageFlip)
+        {
+            // vsyncで待たされない更新方式では、新しいフレームが無ければ少し待機して次の周回へ。
+            // 描画しない周回は計測しない（1msの待機が FrameWait に毎秒千件近く混ざってしまうため）
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        const auto frameWaitEnd = std::chrono::steady_clock::now();
+
+        profiler_.beginFrame();
+        profiler_.record(FrameProfiler::Stage::FrameWait, frameWaitEnd - frameStart);
+        TRACE_COMPLETE(FrameProfiler::getStageName(FrameProfiler::Stage::FrameWait), frameStart, frameWaitEnd);
+#ifdef RASPI_GL_ENABLE_TRACE
+        // SIGUSR1 を受けていれば、ここまでのトレースを書き出す
+        TraceRecorder::instance().dumpIfRequested();
+#endif
+
+        if (newFrame)
         {
-            int ySize = frame.width * frame.height;
-            int uSize = (frame.width / 2) * (frame.height / 2);
+            FrameProfiler::ScopedStage stage(profiler_, FrameProfiler::Stage::Upload, true);
+
+            // デコーダのプレーン配置（オフセットとパディング込みのストライド）をそのまま渡す
+            Renderer::VideoPlane planes[GStreamerSupport::kMaxPlanes];
+            for (int i = 0; i < frame.planeCount; ++i)
+            {
+                planes[i].data = frame.data + frame.planeOffset[i];
+                planes[i].stride = frame.planeStride[i];
+            }
 
-            renderer_.uploadYUVTextures(frame.data, frame.width, frame.height, ySize, uSize);
-            renderer_.renderToFBO();
+            if (frame.format == GStreamerSupport::PixelFormat::NV12)
+            {
+                renderer_.uploadNV12Textures(planes, frame.width, frame.height);
+            }
+            else
+            {
+                renderer_.uploadYUVTextures(planes, frame.width, frame.height);
+            }
+
+            // テクスチャへのアップロードが済んだので、フレームデータはすぐに解放する
+            gstreamer_.releaseFrame(frame);
+            hasFrame = false;
+        }
+
+        glState_.beginFrame();
+
+        // ページフリップ方式ではswapBuffers()がvsyncに同期するので、新しいフレームが無くても
+        // 前フレームの映像のまま描画し、テロップのスクロールを止めない
+        // 通常はバックバッファへ直接合成し、スクリーンショットを撮るフレームだけFBOを経由する
+        {
+            FrameProfiler::ScopedStage stage(profiler_, FrameProfiler::Stage::VideoDraw, true);
+            renderer_.beginFrame(isScreenshot, platform_.getScreenWidth(), platform_.getScreenHeight());
             renderer_.renderYUV(platform_.getScreenWidth(), platform_.getScreenHeight());
-            telopRenderer_.update();
+        }
+        {
+            FrameProfiler::ScopedStage stage(profiler_, FrameProfiler::Stage::TelopUpdate);
+            const std::time_t now = std::time(nullptr);
+            if (clockLane_ >= 0 && now != clockShown_)
+            {
+                std::stringstream clock;
+                clock << std::put_time(std::localtime(&now), "%H:%M:%S");
+                telopRenderer_.setLaneText(clockLane_, clock.str());
+                clockShown_ = now;
+            }
+            // スクロール位置は描画時刻ではなく、このフレームが表示される予測時刻から決める
+            telopRenderer_.update(platform_.predictPresentTime());
+        }
+        {
+            FrameProfiler::ScopedStage stage(profiler_, FrameProfiler::Stage::TelopDraw, true);
             telopRenderer_.render();
-            renderer_.endOffscreenRender();
-
-            // ここで FBO の内容を画面に描画
-            renderer_.renderFBOToScreen(platform_.getScreenWidth(), platform_.getScreenHeight());
+        }
+        if (!telopStartupLogged_ && !telopRenderer_.hasPendingText())
+        {
+            std::cout << "[Telop] Startup text ready in "
+                      << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - telopStartTime_).count()
+                      << " ms" << std::endl;
+            telopStartupLogged_ = true;
+        }
 
+        // FBOを使った場合は、ここで FBO の内容を画面に描画
+        {
+            FrameProfiler::ScopedStage stage(profiler_, FrameProfiler::Stage::Blit, true);
+            renderer_.endFrame(platform_.getScreenWidth(), platform_.getScreenHeight());
+        }
+        {
+            FrameProfiler::ScopedStage stage(profiler_, FrameProfiler::Stage::Swap);
             platform_.swapBuffers();
+        }
+        profiler_.record(FrameProfiler::Stage::Frame, std::chrono::steady_clock::now() - frameStart);
+
+        // スクリーンショット処理
+        if (isScreenshot)
+        {
+            auto t = std::time(nullptr);
+            std::stringstream ss;
+            ss << "ScreenShot_" << std::put_time(std::localtime(&t), "%Y%m%d_%H%M%S") << ".png";
 
-            // スクリーンショット処理
-            if (isScreenshot)
+            std::vector<unsigned char> pixelData;
+            // FBOからピクセルデータを読み取る
+            if (renderer_.readPixelsFromFBO(pixelData, platform_.getScreenWidth(), platform_.getScreenHeight()))
             {
-                auto t = std::time(nullptr);
-                std::stringstream ss;
-                ss << "ScreenShot_" << std::put_time(std::localtime(&t), "%Y%m%d_%H%M%S") << ".png";
-
-                std::vector<unsigned char> pixelData;
-                // FBOからピクセルデータを読み取る
-                if (renderer_.readPixelsFromFBO(pixelData, platform_.getScreenWidth(), platform_.getScreenHeight()))
-                {
-                    // ピクセルデータをPNGとして保存
-                    platform_.savePixelsToPNG(ss.str().c_str(), pixelData.data());
-                    std::cout << "[App] Screenshot saved to " << ss.str() << std::endl;
-                }
-                else
-                {
-                    std::cerr << "[App] Failed to read pixels from FBO." << std::endl;
-                }
-
-                isScreenshot = false;
+                // ピクセルデータをPNGとして保存
+                platform_.savePixelsToPNG(ss.str().c_str(), pixelData.data());
+                std::cout << "[App] Screenshot saved to " << ss.str() << std::endl;
             }
-
-            // FPSカウンターの更新
-            if (fpsCounter.frame())
+            else
             {
-                // 1秒経過したのでログ出力
-                util::LogAvailableMemory();
-                // 経過時間をログ出力
-                timer.LogElapsedTimeHMS();
+                std::cerr << "[App] Failed to read pixels from FBO." << std::endl;
             }
 
-            // フレームデータの解放
-            gstreamer_.releaseFrame(frame);
+            isScreenshot = false;
         }
-        else
+
+        // FPSカウンターの更新
+        if (fpsCounter.frame())
         {
-            // フレームが取得できなかった場合は少し待機
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            const Renderer::TextureRingStats ringStats = renderer_.getTextureRingStats();
+            const GlyphCache::Stats glyphStats = telopRenderer_.getGlyphCacheStats();
+
+            // 描画スレッドで1行ずつ flush しないよう、1秒分をまとめて組み立ててから1回で出力する
+            std::ostringstream report;
+            report << "[FPS] " << fpsCounter.getLastFps() << " fps\n";
+            if (!metrics_.isRunning())
+            {
+                // メトリクスサーバがあれば RSS と稼働時間はそちらで返すので、/proc を読むのも出力も省く
+                const long memKB = util::getAvailableMemory();
+                const long elapsed = timer.GetElapsedTimeSec();
+                report << "Available Memory: " << memKB << " KB\n";
+                report << "Elapsed time: " << elapsed / 3600 << "h " << (elapsed % 3600) / 60 << "m " << elapsed % 60
+                       << "s\n";
+            }
+            if (statsLog_)
+            {
+                // テクスチャリングが枯渇してGPUを待った回数
+                report << "[Renderer] Texture ring exhausted " << ringStats.exhausted << " / " << ringStats.uploads
+                       << " uploads (waited " << ringStats.waitMs << " ms)\n";
+                // 直前のフレームで発行/省略したGLステート変更の数
+                const GLStateCache::FrameStats glStats = glState_.getLastFrameStats();
+                report << "[Renderer] GL state calls issued " << glStats.issued << ", elided " << glStats.elided
+                       << " per frame\n";
+                // テロップのグリフキャッシュ
+                report << "[Telop] Glyph cache " << glyphStats.glyphs << " glyphs, "
+                       << telopRenderer_.getGlyphCacheBytes() / 1024 << " KiB (hits " << glyphStats.hits
+                       << ", misses " << glyphStats.misses << ", evictions " << glyphStats.evictions << ")\n";
+                // スクロールの1フレームの移動量と理想値との差
+                const TelopRenderer::ScrollJitterStats jitter = telopRenderer_.getScrollJitterStats();
+                report << "[Telop] Scroll jitter mean " << jitter.meanErrorPx << " px, max " << jitter.maxErrorPx
+                       << " px over " << jitter.frames << " frames\n";
+                // 段階毎の処理時間の分布（この1秒間）
+                profiler_.appendReport(report);
+            }
+            telopRenderer_.resetScrollJitterStats();
+            std::cout << report.str() << std::flush;
+            // メトリクスサーバへ今の統計を渡す（応答はサーバのスレッドで組み立てる）
+            MetricsServer::RenderStats &stats = metrics_.stats();
+            stats.fps = fpsCounter.getLastFps();
+            stats.frameQueue = gstreamer_.getFrameQueueStats();
+            stats.flips = platform_.getFlipStats();
+            stats.textureRing = ringStats;
+            stats.glyphCache = glyphStats;
+            stats.videoTextureBytes = renderer_.getTextureBytes();
+            stats.glyphTextureBytes = telopRenderer_.getGlyphCacheBytes();
+            metrics_.publish();
         }
     }
 
     std::cout << "Playback finished." << std::endl;
+    metrics_.stop();
+    profiler_.shutdown();
+#ifdef RASPI_GL_ENABLE_TRACE
+    TraceRecorder::instance().stop();
+#endif
+    // 次回の起動では、今回ラスタライズしたグリフをそのまま使う
+    telopRenderer_.saveGlyphCacheFile();
     return true;
 }
@@ -0,0 +1,307 @@
+#include "FrameProfiler.h"
+#include "TraceRecorder.h"
+#include <EGL/egl.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+LatencyHistogram::LatencyHistogram()
+{
+    for (std::atomic<uint64_t> &count : counts_)
+        count.store(0, std::memory_order_relaxed);
+}
+
+int LatencyHistogram::bucketIndex(uint64_t micros)
+{
+    if (micros < kSubBuckets)
+        return static_cast<int>(micros);
+    micros = std::min<uint64_t>(micros, 0xFFFFFFFFull);
+    // 最上位ビットの位置で区間を、続く4ビットで区間内の位置を決める
+    const int exponent = 63 - __builtin_clzll(micros);
+    const int sub = static_cast<int>(micros >> (exponent - 4)) - kSubBuckets;
+    return kSubBuckets + (exponent - 4) * kSubBuckets + sub;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(int index)
+{
+    if (index < kSubBuckets)
+        return static_cast<uint64_t>(index);
+    const int exponent = (index - kSubBuckets) / kSubBuckets + 4;
+    const int sub = (index - kSubBuckets) % kSubBuckets;
+    return (static_cast<uint64_t>(kSubBuckets + sub + 1) << (exponent - 4)) - 1;
+}
+
+void LatencyHistogram::record(uint64_t micros)
+{
+    counts_[bucketIndex(micros)].fetch_add(1, std::memory_order_relaxed);
+    sumMicros_.fetch_add(micros, std::memory_order_relaxed);
+
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (micros > max && !max_.compare_exchange_weak(max, micros, std::memory_order_relaxed))
+    {
+    }
+    uint64_t windowMax = windowMax_.load(std::memory_order_relaxed);
+    while (micros > windowMax && !windowMax_.compare_exchange_weak(windowMax, micros, std::memory_order_relaxed))
+    {
+    }
+}
+
+void LatencyHistogram::snapshot(Snapshot &out) const
+{
+    out.total = 0;
+    for (int i = 0; i < kBucketCount; ++i)
+    {
+        out.counts[i] = counts_[i].load(std::memory_order_relaxed);
+        out.total += out.counts[i];
+    }
+    out.sumMicros = sumMicros_.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::takeWindowMax()
+{
+    return windowMax_.exchange(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::getMax() const
+{
+    return max_.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Snapshot::percentile(double percentile) const
+{
+    if (total == 0)
+        return 0;
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(percentile / 100.0 * total)));
+    uint64_t seen = 0;
+    for (int i = 0; i < kBucketCount; ++i)
+    {
+        seen += counts[i];
+        if (seen >= rank)
+            return bucketUpperBound(i);
+    }
+    return bucketUpperBound(kBucketCount - 1);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::Snapshot::since(const Snapshot &earlier) const
+{
+    Snapshot window;
+    for (int i = 0; i < kBucketCount; ++i)
+    {
+        window.counts[i] = counts[i] - earlier.counts[i];
+        window.total += window.counts[i];
+    }
+    window.sumMicros = sumMicros - earlier.sumMicros;
+    return window;
+}
+
+FrameProfiler::ScopedStage::ScopedStage(FrameProfiler &profiler, Stage stage, bool gpu)
+    : profiler_(profiler), stage_(stage), gpu_(gpu && profiler.beginGpuQuery(stage)),
+      start_(std::chrono::steady_clock::now())
+{
+}
+
+FrameProfiler::ScopedStage::~ScopedStage()
+{
+    const auto end = std::chrono::steady_clock::now();
+    profiler_.record(stage_, end - start_);
+    TRACE_COMPLETE(getStageName(stage_), start_, end);
+    if (gpu_)
+        profiler_.endGpuQuery();
+}
+
+FrameProfiler::FrameProfiler()
+{
+}
+
+FrameProfiler::~FrameProfiler()
+{
+}
+
+bool FrameProfiler::enableGpuTimers()
+{
+    const char *extensions = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+    if (!extensions || !std::strstr(extensions, "GL_EXT_disjoint_timer_query"))
+    {
+        std::cout << "[Profiler] GL_EXT_disjoint_timer_query is not available. GPU times are not measured." << std::endl;
+        return false;
+    }
+
+    glGenQueriesEXT_ = reinterpret_cast<PFNGLGENQUERIESEXTPROC>(eglGetProcAddress("glGenQueriesEXT"));
+    glDeleteQueriesEXT_ = reinterpret_cast<PFNGLDELETEQUERIESEXTPROC>(eglGetProcAddress("glDeleteQueriesEXT"));
+    glBeginQueryEXT_ = reinterpret_cast<PFNGLBEGINQUERYEXTPROC>(eglGetProcAddress("glBeginQueryEXT"));
+    glEndQueryEXT_ = reinterpret_cast<PFNGLENDQUERYEXTPROC>(eglGetProcAddress("glEndQueryEXT"));
+    glGetQueryObjectuivEXT_ = reinterpret_cast<PFNGLGETQUERYOBJECTUIVEXTPROC>(eglGetProcAddress("glGetQueryObjectuivEXT"));
+    glGetQueryObjectui64vEXT_ =
+        reinterpret_cast<PFNGLGETQUERYOBJECTUI64VEXTPROC>(eglGetProcAddress("glGetQueryObjectui64vEXT"));
+    if (!glGenQueriesEXT_ || !glDeleteQueriesEXT_ || !glBeginQueryEXT_ || !glEndQueryEXT_ || !glGetQueryObjectuivEXT_ ||
+        !glGetQueryObjectui64vEXT_)
+    {
+        std::cerr << "[Profiler] Failed to load the GL_EXT_disjoint_timer_query functions." << std::endl;
+        return false;
+    }
+
+    for (int stage = 0; stage < kStageCount; ++stage)
+    {
+        for (GpuQuery &query : queries_[stage])
+            glGenQueriesEXT_(1, &query.id);
+    }
+    gpuTimers_ = true;
+    std::cout << "[Profiler] GPU timer queries enabled." << std::endl;
+    return true;
+}
+
+void FrameProfiler::shutdown()
+{
+    if (!gpuTimers_)
+        return;
+    if (queryActive_)
+        endGpuQuery();
+    for (int stage = 0; stage < kStageCount; ++stage)
+    {
+        for (GpuQuery &query : queries_[stage])
+        {
+            glDeleteQueriesEXT_(1, &query.id);
+            query = GpuQuery();
+        }
+    }
+    gpuTimers_ = false;
+}
+
+bool FrameProfiler::hasGpuTimers() const
+{
+    return gpuTimers_;
+}
+
+void FrameProfiler::beginFrame()
+{
+    if (!gpuTimers_)
+        return;
+
+    // クロックの変化や省電力などで計測が途切れた場合、その間の結果は信用できないので捨てる
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+
+    for (int stage = 0; stage < kStageCount; ++stage)
+    {
+        for (GpuQuery &query : queries_[stage])
+        {
+            if (!query.pending)
+                continue;
+            GLuint available = 0;
+            glGetQueryObjectuivEXT_(query.id, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+            if (!available)
+                continue;
+            query.pending = false;
+            if (disjoint)
+                continue;
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64vEXT_(query.id, GL_QUERY_RESULT_EXT, &nanoseconds);
+            gpu_[stage].record(nanoseconds / 1000);
+        }
+    }
+}
+
+bool FrameProfiler::beginGpuQuery(Stage stage)
+{
+    if (!gpuTimers_ || queryActive_)
+        return false;
+
+    // 結果がまだ届いていないクエリは再利用できないので、その回はGPU時間を計測しない
+    const int index = static_cast<int>(stage);
+    GpuQuery &query = queries_[index][nextQuery_[index]];
+    if (query.pending)
+        return false;
+    nextQuery_[index] = (nextQuery_[index] + 1) % kQueriesPerStage;
+
+    glBeginQueryEXT_(GL_TIME_ELAPSED_EXT, query.id);
+    activeQuery_ = &query;
+    queryActive_ = true;
+    return true;
+}
+
+void FrameProfiler::endGpuQuery()
+{
+    glEndQueryEXT_(GL_TIME_ELAPSED_EXT);
+    activeQuery_->pending = true;
+    activeQuery_ = nullptr;
+    queryActive_ = false;
+}
+
+void FrameProfiler::record(Stage stage, std::chrono::steady_clock::duration elapsed)
+{
+    cpu_[static_cast<int>(stage)].record(
+        static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+}
+
+LatencyHistogram &FrameProfiler::getCpuHistogram(Stage stage)
+{
+    return cpu_[static_cast<int>(stage)];
+}
+
+LatencyHistogram &FrameProfiler::getGpuHistogram(Stage stage)
+{
+    return gpu_[static_cast<int>(stage)];
+}
+
+const char *FrameProfiler::getStageName(Stage stage)
+{
+    switch (stage)
+    {
+    case Stage::FrameWait:
+        return "frame_wait";
+    case Stage::Upload:
+        return "upload";
+    case Stage::VideoDraw:
+        return "video_draw";
+    case Stage::TelopUpdate:
+        return "telop_update";
+    case Stage::TelopDraw:
+        return "telop_draw";
+    case Stage::Blit:
+        return "blit";
+    case Stage::Swap:
+        return "swap";
+    case Stage::Frame:
+        return "frame";
+    case Stage::Count:
+        break;
+    }
+    return "unknown";
+}
+
+void FrameProfiler::appendReport(std::ostream &report)
+{
+    const std::ios::fmtflags flags = report.flags();
+    const std::streamsize precision = report.precision();
+    report << std::fixed << std::setprecision(2);
+    for (int stage = 0; stage < kStageCount; ++stage)
+    {
+        LatencyHistogram::Snapshot current;
+        cpu_[stage].snapshot(current);
+        const LatencyHistogram::Snapshot window = current.since(lastCpu_[stage]);
+        lastCpu_[stage] = current;
+        const uint64_t cpuMax = cpu_[stage].takeWindowMax();
+
+        // GPUの結果は数フレーム遅れて届くので、CPUの記録が無い区間でも区切りを進め、次の区間に持ち越さない
+        gpu_[stage].snapshot(current);
+        const LatencyHistogram::Snapshot gpuWindow = current.since(lastGpu_[stage]);
+        lastGpu_[stage] = current;
+        const uint64_t gpuMax = gpu_[stage].takeWindowMax();
+        if (window.total == 0)
+            continue;
+
+        report << "[Profiler] " << std::left << std::setw(12) << getStageName(static_cast<Stage>(stage)) << std::right
+               << " cpu p50 " << window.percentile(50) / 1000.0 << " p95 " << window.percentile(95) / 1000.0
+               << " p99 " << window.percentile(99) / 1000.0 << " max " << cpuMax / 1000.0 << " ms";
+        if (gpuWindow.total > 0)
+        {
+            report << " | gpu p50 " << gpuWindow.percentile(50) / 1000.0 << " p95 " << gpuWindow.percentile(95) / 1000.0
+                   << " p99 " << gpuWindow.percentile(99) / 1000.0 << " max " << gpuMax / 1000.0 << " ms";
+        }
+        report << " (" << window.total << " samples)\n";
+    }
+    report.flags(flags);
+    report.precision(precision);
+}
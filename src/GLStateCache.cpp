@@ -0,0 +1,256 @@
+#include "GLStateCache.h"
+#include <cstring>
+
+GLStateCache::GLStateCache()
+{
+    invalidate();
+}
+
+void GLStateCache::invalidate()
+{
+    program_ = kUnknown;
+    activeUnit_ = kUnknown;
+    for (GLuint &texture : textures_)
+    {
+        texture = kUnknown;
+    }
+    arrayBuffer_ = kUnknown;
+    for (VertexAttrib &attrib : attribs_)
+    {
+        attrib = VertexAttrib();
+    }
+    blendEnabled_ = -1;
+    blendSrc_ = kUnknown;
+    blendDst_ = kUnknown;
+    blendSrcAlpha_ = kUnknown;
+    blendDstAlpha_ = kUnknown;
+    uniforms_.clear();
+}
+
+void GLStateCache::beginFrame()
+{
+    last_ = current_;
+    current_ = FrameStats();
+}
+
+GLStateCache::FrameStats GLStateCache::getLastFrameStats() const
+{
+    return last_;
+}
+
+bool GLStateCache::track(bool changed)
+{
+    if (changed)
+        current_.issued++;
+    else
+        current_.elided++;
+    return changed;
+}
+
+void GLStateCache::useProgram(GLuint program)
+{
+    if (track(program_ != program))
+    {
+        glUseProgram(program);
+        program_ = program;
+    }
+}
+
+void GLStateCache::bindTexture(GLenum unit, GLuint texture)
+{
+    const int index = static_cast<int>(unit - GL_TEXTURE0);
+    if (index < 0 || index >= kMaxTextureUnits)
+    {
+        // 追跡対象外のユニットはそのまま発行する
+        glActiveTexture(unit);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        activeUnit_ = unit;
+        current_.issued += 2;
+        return;
+    }
+    if (textures_[index] == texture)
+    {
+        current_.elided++;
+        return;
+    }
+    if (track(activeUnit_ != unit))
+    {
+        glActiveTexture(unit);
+        activeUnit_ = unit;
+    }
+    track(true);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    textures_[index] = texture;
+}
+
+void GLStateCache::bindArrayBuffer(GLuint buffer)
+{
+    if (track(arrayBuffer_ != buffer))
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        arrayBuffer_ = buffer;
+    }
+}
+
+void GLStateCache::enableVertexAttribArray(GLuint index)
+{
+    if (index >= kMaxVertexAttribs)
+    {
+        glEnableVertexAttribArray(index);
+        current_.issued++;
+        return;
+    }
+    VertexAttrib &attrib = attribs_[index];
+    if (track(!attrib.known || !attrib.enabled))
+    {
+        glEnableVertexAttribArray(index);
+        attrib.enabled = true;
+        attrib.known = true;
+    }
+}
+
+void GLStateCache::disableVertexAttribArray(GLuint index)
+{
+    if (index >= kMaxVertexAttribs)
+    {
+        glDisableVertexAttribArray(index);
+        current_.issued++;
+        return;
+    }
+    VertexAttrib &attrib = attribs_[index];
+    if (track(!attrib.known || attrib.enabled))
+    {
+        glDisableVertexAttribArray(index);
+        attrib.enabled = false;
+        attrib.known = true;
+    }
+}
+
+void GLStateCache::vertexAttribPointer(GLuint index, GLint size, GLsizei stride, uintptr_t offset)
+{
+    const void *pointer = reinterpret_cast<const void *>(offset);
+    if (index >= kMaxVertexAttribs)
+    {
+        glVertexAttribPointer(index, size, GL_FLOAT, GL_FALSE, stride, pointer);
+        current_.issued++;
+        return;
+    }
+    VertexAttrib &attrib = attribs_[index];
+    bool changed = attrib.buffer != arrayBuffer_ || attrib.size != size ||
+                   attrib.stride != stride || attrib.offset != offset;
+    if (track(changed))
+    {
+        glVertexAttribPointer(index, size, GL_FLOAT, GL_FALSE, stride, pointer);
+        attrib.buffer = arrayBuffer_;
+        attrib.size = size;
+        attrib.stride = stride;
+        attrib.offset = offset;
+    }
+}
+
+void GLStateCache::setBlendEnabled(bool enabled)
+{
+    const int value = enabled ? 1 : 0;
+    if (track(blendEnabled_ != value))
+    {
+        if (enabled)
+            glEnable(GL_BLEND);
+        else
+            glDisable(GL_BLEND);
+        blendEnabled_ = value;
+    }
+}
+
+void GLStateCache::blendFunc(GLenum sfactor, GLenum dfactor)
+{
+    blendFuncSeparate(sfactor, dfactor, sfactor, dfactor);
+}
+
+void GLStateCache::blendFuncSeparate(GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha)
+{
+    if (track(blendSrc_ != srcRGB || blendDst_ != dstRGB || blendSrcAlpha_ != srcAlpha || blendDstAlpha_ != dstAlpha))
+    {
+        if (srcRGB == srcAlpha && dstRGB == dstAlpha)
+            glBlendFunc(srcRGB, dstRGB);
+        else
+            glBlendFuncSeparate(srcRGB, dstRGB, srcAlpha, dstAlpha);
+        blendSrc_ = srcRGB;
+        blendDst_ = dstRGB;
+        blendSrcAlpha_ = srcAlpha;
+        blendDstAlpha_ = dstAlpha;
+    }
+}
+
+uint64_t GLStateCache::uniformKey(GLint location) const
+{
+    return (static_cast<uint64_t>(program_) << 32) | static_cast<uint32_t>(location);
+}
+
+bool GLStateCache::updateUniform(GLint location, const UniformValue &value)
+{
+    auto result = uniforms_.emplace(uniformKey(location), value);
+    if (result.second)
+        return track(true);
+    bool changed = std::memcmp(&result.first->second, &value, sizeof(UniformValue)) != 0;
+    if (changed)
+        result.first->second = value;
+    return track(changed);
+}
+
+void GLStateCache::uniform1i(GLint location, GLint value)
+{
+    if (location < 0)
+        return;
+    UniformValue v = {{0.0f, 0.0f, 0.0f, 0.0f}, value};
+    if (updateUniform(location, v))
+        glUniform1i(location, value);
+}
+
+void GLStateCache::uniform1f(GLint location, GLfloat value)
+{
+    if (location < 0)
+        return;
+    UniformValue v = {{value, 0.0f, 0.0f, 0.0f}, 0};
+    if (updateUniform(location, v))
+        glUniform1f(location, value);
+}
+
+void GLStateCache::uniform2f(GLint location, GLfloat x, GLfloat y)
+{
+    if (location < 0)
+        return;
+    UniformValue v = {{x, y, 0.0f, 0.0f}, 0};
+    if (updateUniform(location, v))
+        glUniform2f(location, x, y);
+}
+
+void GLStateCache::uniform4f(GLint location, GLfloat x, GLfloat y, GLfloat z, GLfloat w)
+{
+    if (location < 0)
+        return;
+    UniformValue v = {{x, y, z, w}, 0};
+    if (updateUniform(location, v))
+        glUniform4f(location, x, y, z, w);
+}
+
+void GLStateCache::forgetTexture(GLuint texture)
+{
+    for (GLuint &bound : textures_)
+    {
+        if (bound == texture)
+            bound = kUnknown;
+    }
+}
+
+void GLStateCache::forgetProgram(GLuint program)
+{
+    if (program_ == program)
+        program_ = kUnknown;
+    for (auto it = uniforms_.begin(); it != uniforms_.end();)
+    {
+        if ((it->first >> 32) == program)
+            it = uniforms_.erase(it);
+        else
+            ++it;
+    }
+}
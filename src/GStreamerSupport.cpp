@@ -1,6 +1,10 @@
 #include "GStreamerSupport.h"
+#include "TraceRecorder.h"
 #include <iostream>
 #include <cstring> // ← これを追加
+#include <chrono>
+#include <thread>
+#include <algorithm>
 
 bool GStreamerSupport::initialize()
 {
@@ -10,6 +14,8 @@ bool GStreamerSupport::initialize()
 
 void GStreamerSupport::finalize()
 {
+    // Fifo方針で空きを待っているストリーミングスレッドを先に解放する
+    stopping_ = true;
     if (pipeline_)
     {
         gst_element_set_state(pipeline_, GST_STATE_NULL);
@@ -21,19 +27,74 @@ void GStreamerSupport::finalize()
         gst_object_unref(appsink_);
         appsink_ = nullptr;
     }
+    // ストリーミングスレッドが止まったので、残りのフレームを解放できる
+    drainFrameQueue();
+}
+
+void GStreamerSupport::setFrameQueue(size_t depth, FrameQueuePolicy policy)
+{
+    drainFrameQueue();
+    frameQueue_.reset(depth);
+    queuePolicy_ = policy;
+}
+
+void GStreamerSupport::drainFrameQueue()
+{
+    FrameData frame;
+    while (frameQueue_.pop(frame))
+    {
+        releaseFrame(frame);
+    }
+    if (FrameData *overflow = overflowFrame_.exchange(nullptr, std::memory_order_acquire))
+    {
+        releaseFrame(*overflow);
+        delete overflow;
+    }
+}
+
+void GStreamerSupport::setVideoDecoder(const char *element)
+{
+    videoDecoder_ = (element && *element) ? element : "avdec_h264";
 }
 
 bool GStreamerSupport::startPipeline(const char *filepath)
 {
-    std::string pipelineDesc = std::string("filesrc location=") + filepath +
-                               " ! qtdemux name=demux "
-                               " demux.video_0 ! queue "
-                               " ! h264parse ! avdec_h264 "
-                               " ! queue "
-                               " ! videoconvert "
-                               " ! video/x-raw,format=I420 "
-                               " ! appsink name=mysink sync=true";
+    std::string decoder = videoDecoder_;
+    if (GstElementFactory *factory = gst_element_factory_find(decoder.c_str()))
+    {
+        gst_object_unref(factory);
+    }
+    else
+    {
+        std::cerr << "[GStreamer] Decoder element " << decoder << " is not available. Using avdec_h264." << std::endl;
+        decoder = "avdec_h264";
+    }
+
+    const std::string sourceDesc = std::string("filesrc location=") + filepath +
+                                   " ! qtdemux name=demux "
+                                   " demux.video_0 ! queue "
+                                   " ! h264parse ! " + decoder +
+                                   " ! queue ";
 
+    // デコーダの出力をそのまま受け取る（NV12優先）。CPUでの色変換は行わない
+    const std::string nativeDesc = sourceDesc +
+                                   " ! appsink name=mysink sync=true"
+                                   " caps=\"video/x-raw,format=(string){NV12,I420}\"";
+    if (launchPipeline(nativeDesc))
+        return true;
+
+    // デコーダがNV12/I420を出力できない場合のみ、videoconvertでI420に変換する
+    std::cout << "[GStreamer] Decoder output is not NV12/I420. Falling back to videoconvert." << std::endl;
+    finalize();
+    const std::string convertDesc = sourceDesc +
+                                    " ! videoconvert "
+                                    " ! video/x-raw,format=I420 "
+                                    " ! appsink name=mysink sync=true";
+    return launchPipeline(convertDesc);
+}
+
+bool GStreamerSupport::launchPipeline(const std::string &pipelineDesc)
+{
     GError *error = nullptr;
     pipeline_ = gst_parse_launch(pipelineDesc.c_str(), &error);
     if (!pipeline_)
@@ -55,7 +116,21 @@ bool GStreamerSupport::startPipeline(const char *filepath)
     gst_app_sink_set_max_buffers(GST_APP_SINK(appsink_), 10);
     //    g_object_set(G_OBJECT(appsink_), "sync", FALSE, nullptr);
 
+    // サンプルの取り出しとマップはストリーミングスレッド側で行い、描画スレッドには渡すだけにする
+    GstAppSinkCallbacks callbacks = {};
+    callbacks.new_sample = &GStreamerSupport::onNewSample;
+    gst_app_sink_set_callbacks(GST_APP_SINK(appsink_), &callbacks, this, nullptr);
+
+    stopping_ = false;
+    formatLogged_ = false;
     gst_element_set_state(pipeline_, GST_STATE_PLAYING);
+
+    // capsのネゴシエーションに失敗した場合はプリロールが失敗する
+    if (gst_element_get_state(pipeline_, nullptr, nullptr, 5 * GST_SECOND) == GST_STATE_CHANGE_FAILURE)
+    {
+        std::cerr << "[GStreamer] Pipeline failed to preroll." << std::endl;
+        return false;
+    }
     return true;
 }
 
@@ -67,47 +142,144 @@ bool GStreamerSupport::restartPipeline(const char *filepath)
     return startPipeline(filepath);
 }
 
-bool GStreamerSupport::getFrameData(FrameData &outFrame)
+GstFlowReturn GStreamerSupport::onNewSample(GstAppSink *sink, gpointer user_data)
 {
-    if (!appsink_)
-        return false;
+    GStreamerSupport *self = static_cast<GStreamerSupport *>(user_data);
 
-    GstSample *sample = gst_app_sink_try_pull_sample(GST_APP_SINK(appsink_), 10000000); // 10ms
+    GstSample *sample = gst_app_sink_pull_sample(sink);
     if (!sample)
-    {
-        if (gst_app_sink_is_eos(GST_APP_SINK(appsink_)))
-        {
-            //            std::cerr << "[GStreamer] End of stream reached (EOS)." << std::endl;
-        }
-        else
-        {
-            //            std::cerr << "[GStreamer] Failed to pull sample (timeout or not ready)." << std::endl;
-        }
-        return false;
-    }
+        return GST_FLOW_EOS;
 
     GstBuffer *buffer = gst_sample_get_buffer(sample);
     GstCaps *caps = gst_sample_get_caps(sample);
     if (!buffer || !caps)
     {
         gst_sample_unref(sample);
-        return false;
+        return GST_FLOW_OK;
+    }
+
+    GstVideoInfo info;
+    if (!gst_video_info_from_caps(&info, caps))
+    {
+        gst_sample_unref(sample);
+        return GST_FLOW_OK;
     }
 
-    GstStructure *s = gst_caps_get_structure(caps, 0);
-    gst_structure_get_int(s, "width", &outFrame.width);
-    gst_structure_get_int(s, "height", &outFrame.height);
+    FrameData frame;
+    frame.width = GST_VIDEO_INFO_WIDTH(&info);
+    frame.height = GST_VIDEO_INFO_HEIGHT(&info);
+    frame.format = (GST_VIDEO_INFO_FORMAT(&info) == GST_VIDEO_FORMAT_NV12) ? PixelFormat::NV12 : PixelFormat::I420;
+    if (!self->formatLogged_.load(std::memory_order_relaxed))
+    {
+        // どちらのアップロードパスを使うかは、デコーダが出力する形式で決まる
+        self->formatLogged_.store(true, std::memory_order_relaxed);
+        std::cout << "[GStreamer] Receiving " << (frame.format == PixelFormat::NV12 ? "NV12" : "I420") << " "
+                  << frame.width << "x" << frame.height << " frames." << std::endl;
+    }
+
+    // プレーン配置はcapsから求めた既定値を使い、デコーダがGstVideoMetaで
+    // パディング込みの配置を通知している場合はそちらを優先する
+    GstVideoMeta *meta = gst_buffer_get_video_meta(buffer);
+    frame.planeCount = std::min<int>(meta ? meta->n_planes : GST_VIDEO_INFO_N_PLANES(&info), kMaxPlanes);
+    for (int i = 0; i < frame.planeCount; ++i)
+    {
+        frame.planeOffset[i] = meta ? meta->offset[i] : GST_VIDEO_INFO_PLANE_OFFSET(&info, i);
+        frame.planeStride[i] = meta ? meta->stride[i] : GST_VIDEO_INFO_PLANE_STRIDE(&info, i);
+    }
+    frame.stride = frame.planeStride[0];
 
-    if (!gst_buffer_map(buffer, &outFrame.map, GST_MAP_READ))
+    if (!gst_buffer_map(buffer, &frame.map, GST_MAP_READ))
     {
         gst_sample_unref(sample);
-        return false;
+        return GST_FLOW_OK;
     }
+    frame.data = frame.map.data;
+    frame.sample = sample;
+    frame.sequence = self->framesReceived_++;
+    frame.ptsMicros =
+        GST_BUFFER_PTS_IS_VALID(buffer) ? static_cast<int64_t>(GST_BUFFER_PTS(buffer) / GST_USECOND) : -1;
+    TRACE_INSTANT("sample", "pts_us", frame.ptsMicros);
 
-    outFrame.data = outFrame.map.data;
-    outFrame.sample = sample;
-    // stride を取得したい場合は caps から取り出す（必要なら）
-    return true;
+    while (!self->frameQueue_.push(std::move(frame)))
+    {
+        if (self->stopping_)
+        {
+            self->framesDropped_++;
+            TRACE_INSTANT("sample_dropped", "pts_us", frame.ptsMicros);
+            self->releaseFrame(frame);
+            break;
+        }
+        if (self->queuePolicy_ == FrameQueuePolicy::Latest)
+        {
+            // 描画側が追いついていない。キュー内の古いフレームは描画側が読み捨てるので、
+            // 届いたフレームは上書き用の枠に置き、そこにあった1つ前の最新フレームを諦める
+            FrameData *replaced =
+                self->overflowFrame_.exchange(new FrameData(std::move(frame)), std::memory_order_acq_rel);
+            if (replaced)
+            {
+                self->framesDropped_++;
+                TRACE_INSTANT("sample_dropped", "pts_us", replaced->ptsMicros);
+                self->releaseFrame(*replaced);
+                delete replaced;
+            }
+            break;
+        }
+        // Fifo: 描画側が取り出すまでストリーミングスレッドを待たせる
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return GST_FLOW_OK;
+}
+
+bool GStreamerSupport::getFrameData(FrameData &outFrame)
+{
+    bool found = frameQueue_.pop(outFrame);
+    if (queuePolicy_ != FrameQueuePolicy::Latest)
+        return found;
+
+    // 溜まっているフレームは読み捨て、最新の1枚だけを返す
+    FrameData newer;
+    while (found && frameQueue_.pop(newer))
+    {
+        releaseFrame(outFrame);
+        outFrame = newer;
+        framesSkipped_++;
+        TRACE_INSTANT("frame_skipped", nullptr, 0);
+    }
+
+    // キューが満杯だった間に届いたフレームは上書き用の枠にある。キューの先頭と比べて新しい方を使う
+    FrameData *overflow = overflowFrame_.exchange(nullptr, std::memory_order_acq_rel);
+    if (overflow)
+    {
+        if (!found || overflow->sequence > outFrame.sequence)
+        {
+            if (found)
+            {
+                releaseFrame(outFrame);
+                framesSkipped_++;
+                TRACE_INSTANT("frame_skipped", nullptr, 0);
+            }
+            outFrame = *overflow;
+            found = true;
+        }
+        else
+        {
+            releaseFrame(*overflow);
+            framesSkipped_++;
+            TRACE_INSTANT("frame_skipped", nullptr, 0);
+        }
+        delete overflow;
+    }
+    return found;
+}
+
+GStreamerSupport::FrameQueueStats GStreamerSupport::getFrameQueueStats() const
+{
+    FrameQueueStats stats;
+    stats.received = framesReceived_.load(std::memory_order_relaxed);
+    stats.dropped = framesDropped_.load(std::memory_order_relaxed);
+    stats.skipped = framesSkipped_.load(std::memory_order_relaxed);
+    stats.depth = frameQueue_.size();
+    return stats;
 }
 
 bool GStreamerSupport::checkBusMessages()
@@ -0,0 +1,427 @@
+#include "GlyphAtlas.h"
+#include "GLStateCache.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+    // save()/load() の数値は全て int32 で並べる
+    void writeInt(std::ostream &out, int32_t value)
+    {
+        out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    // 再利用した枠の余りをこの大きさ(gutter除く)未満なら切り分けず、枠に含めたままにする
+    const int kMinFreeSlotSize = 8;
+
+    bool readInt(const uint8_t *data, size_t size, size_t &offset, int32_t &value)
+    {
+        if (offset + sizeof(value) > size)
+            return false;
+        std::memcpy(&value, data + offset, sizeof(value)); // mmap上の位置は揃っていないことがある
+        offset += sizeof(value);
+        return true;
+    }
+}
+
+GlyphAtlas::GlyphAtlas()
+{
+}
+
+GlyphAtlas::~GlyphAtlas()
+{
+    shutdown();
+}
+
+void GlyphAtlas::initialize(GLStateCache &glState, int pageSize, int gutter)
+{
+    glState_ = &glState;
+
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    pageSize_ = maxTextureSize > 0 ? std::min(pageSize, static_cast<int>(maxTextureSize)) : pageSize;
+    gutter_ = std::max(gutter, 0);
+}
+
+void GlyphAtlas::setMaxPages(int maxPages)
+{
+    maxPages_ = std::max(maxPages, 0);
+}
+
+void GlyphAtlas::setKeepPixels(bool keep)
+{
+    keepPixels_ = keep;
+}
+
+void GlyphAtlas::shutdown()
+{
+    for (Page &page : pages_)
+    {
+        if (glState_)
+            glState_->forgetTexture(page.texture);
+        glDeleteTextures(1, &page.texture);
+    }
+    pages_.clear();
+}
+
+bool GlyphAtlas::insert(const uint8_t *pixels, int width, int height, Region &outRegion)
+{
+    if (width + gutter_ > pageSize_ || height + gutter_ > pageSize_)
+    {
+        std::cerr << "[GlyphAtlas] Glyph " << width << "x" << height << " does not fit in a "
+                  << pageSize_ << "x" << pageSize_ << " page." << std::endl;
+        return false;
+    }
+
+    // 既存ページの空きに詰め、どこにも入らなければページを追加する
+    int page = 0;
+    int x = 0;
+    int y = 0;
+    int slotWidth = 0;
+    int slotHeight = 0;
+    for (; page < static_cast<int>(pages_.size()); ++page)
+    {
+        if (allocate(pages_[page], width, height, x, y, slotWidth, slotHeight))
+            break;
+    }
+    if (page == static_cast<int>(pages_.size()))
+    {
+        if (maxPages_ > 0 && static_cast<int>(pages_.size()) >= maxPages_)
+            return false;
+        if (!addPage() || !allocate(pages_.back(), width, height, x, y, slotWidth, slotHeight))
+            return false;
+    }
+
+    writePixels(pages_[page], x, y, width, height, pixels);
+
+    const float scale = 1.0f / pageSize_;
+    outRegion.page = page;
+    outRegion.x = x;
+    outRegion.y = y;
+    outRegion.width = width;
+    outRegion.height = height;
+    outRegion.u0 = x * scale;
+    outRegion.v0 = y * scale;
+    outRegion.u1 = (x + width) * scale;
+    outRegion.v1 = (y + height) * scale;
+    outRegion.slotWidth = slotWidth;
+    outRegion.slotHeight = slotHeight;
+    return true;
+}
+
+void GlyphAtlas::release(const Region &region)
+{
+    if (region.page < 0 || region.page >= static_cast<int>(pages_.size()))
+        return;
+
+    // 前のグリフが残っていると、小さなグリフを格納した時にgutterへはみ出して見えるので消しておく
+    const int width = std::min(region.slotWidth, pageSize_ - region.x);
+    const int height = std::min(region.slotHeight, pageSize_ - region.y);
+    if (width > 0 && height > 0)
+    {
+        const size_t bytes = static_cast<size_t>(width) * height;
+        if (zeros_.size() < bytes)
+            zeros_.resize(bytes, 0);
+        writePixels(pages_[region.page], region.x, region.y, width, height, zeros_.data());
+    }
+
+    FreeSlot slot;
+    slot.x = region.x;
+    slot.y = region.y;
+    slot.width = region.slotWidth;
+    slot.height = region.slotHeight;
+    pages_[region.page].freeSlots.push_back(slot);
+}
+
+bool GlyphAtlas::isInsidePage(int x, int y, int width, int height) const
+{
+    // 加算で桁あふれしないよう、引き算で比べる
+    return x >= 0 && y >= 0 && width >= 0 && height >= 0 && x <= pageSize_ && y <= pageSize_ &&
+           width <= pageSize_ - x && height <= pageSize_ - y;
+}
+
+bool GlyphAtlas::isValidRegion(const Region &region) const
+{
+    return region.page >= 0 && region.page < static_cast<int>(pages_.size()) && region.slotWidth > 0 &&
+           region.slotHeight > 0 && isInsidePage(region.x, region.y, region.slotWidth, region.slotHeight) &&
+           region.width >= 0 && region.height >= 0 && region.width <= region.slotWidth &&
+           region.height <= region.slotHeight;
+}
+
+bool GlyphAtlas::fitsInPage(int width, int height) const
+{
+    return width + gutter_ <= pageSize_ && height + gutter_ <= pageSize_;
+}
+
+bool GlyphAtlas::canReuse(const Region &region, int width, int height) const
+{
+    return region.page >= 0 && region.slotWidth >= width + gutter_ && region.slotHeight >= height + gutter_;
+}
+
+void GlyphAtlas::resetPage(int page)
+{
+    if (page < 0 || page >= static_cast<int>(pages_.size()))
+        return;
+
+    Page &target = pages_[page];
+    const size_t pageBytes = static_cast<size_t>(pageSize_) * pageSize_;
+    if (zeros_.size() < pageBytes)
+        zeros_.resize(pageBytes, 0);
+    writePixels(target, 0, 0, pageSize_, pageSize_, zeros_.data());
+    target.shelves.clear();
+    target.freeSlots.clear();
+    target.nextShelfY = 0;
+}
+
+GLuint GlyphAtlas::getPageTexture(int page) const
+{
+    return pages_[page].texture;
+}
+
+int GlyphAtlas::getPageCount() const
+{
+    return static_cast<int>(pages_.size());
+}
+
+int GlyphAtlas::getPageSize() const
+{
+    return pageSize_;
+}
+
+size_t GlyphAtlas::getTextureBytes() const
+{
+    return pages_.size() * static_cast<size_t>(pageSize_) * pageSize_;
+}
+
+bool GlyphAtlas::addPage(const uint8_t *pixels)
+{
+    Page page;
+    glGenTextures(1, &page.texture);
+    glState_->bindTexture(GL_TEXTURE0, page.texture);
+
+    // 隙間が透明になるよう、内容の指定が無ければページ全体をゼロで確保する
+    const size_t pageBytes = static_cast<size_t>(pageSize_) * pageSize_;
+    std::vector<uint8_t> zeros;
+    if (!pixels)
+    {
+        zeros.assign(pageBytes, 0);
+        pixels = zeros.data();
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, pageSize_, pageSize_, 0, GL_ALPHA, GL_UNSIGNED_BYTE, pixels);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (glGetError() != GL_NO_ERROR)
+    {
+        std::cerr << "[GlyphAtlas] Failed to allocate atlas page " << pages_.size() << "." << std::endl;
+        glState_->forgetTexture(page.texture);
+        glDeleteTextures(1, &page.texture);
+        return false;
+    }
+
+    if (keepPixels_)
+    {
+        if (zeros.empty())
+            page.pixels.assign(pixels, pixels + pageBytes);
+        else
+            page.pixels.swap(zeros);
+    }
+    pages_.push_back(std::move(page));
+    std::cout << "[GlyphAtlas] Allocated page " << pages_.size() - 1 << " (" << pageSize_ << "x" << pageSize_
+              << ")" << std::endl;
+    return true;
+}
+
+void GlyphAtlas::writePixels(Page &page, int x, int y, int width, int height, const uint8_t *pixels)
+{
+    if (width <= 0 || height <= 0)
+        return;
+    glState_->bindTexture(GL_TEXTURE0, page.texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_ALPHA, GL_UNSIGNED_BYTE, pixels);
+
+    if (!page.pixels.empty())
+    {
+        for (int row = 0; row < height; ++row)
+        {
+            std::memcpy(&page.pixels[static_cast<size_t>(y + row) * pageSize_ + x], pixels + static_cast<size_t>(row) * width,
+                        width);
+        }
+    }
+}
+
+bool GlyphAtlas::save(std::ostream &out) const
+{
+    if (!keepPixels_)
+    {
+        std::cerr << "[GlyphAtlas] Cannot save the atlas without keeping the page pixels." << std::endl;
+        return false;
+    }
+
+    // ページ数、ページ毎に空き領域の状態と画素
+    writeInt(out, static_cast<int32_t>(pages_.size()));
+    for (const Page &page : pages_)
+    {
+        writeInt(out, page.nextShelfY);
+        writeInt(out, static_cast<int32_t>(page.shelves.size()));
+        writeInt(out, static_cast<int32_t>(page.freeSlots.size()));
+        for (const Shelf &shelf : page.shelves)
+        {
+            writeInt(out, shelf.y);
+            writeInt(out, shelf.height);
+            writeInt(out, shelf.x);
+        }
+        for (const FreeSlot &slot : page.freeSlots)
+        {
+            writeInt(out, slot.x);
+            writeInt(out, slot.y);
+            writeInt(out, slot.width);
+            writeInt(out, slot.height);
+        }
+        out.write(reinterpret_cast<const char *>(page.pixels.data()), page.pixels.size());
+    }
+    return static_cast<bool>(out);
+}
+
+bool GlyphAtlas::load(const uint8_t *data, size_t size, size_t &outConsumed)
+{
+    shutdown();
+
+    const size_t pageBytes = static_cast<size_t>(pageSize_) * pageSize_;
+    size_t offset = 0;
+    int32_t pageCount = 0;
+    if (!readInt(data, size, offset, pageCount) || pageCount < 0 || (maxPages_ > 0 && pageCount > maxPages_))
+        return false;
+
+    for (int32_t i = 0; i < pageCount; ++i)
+    {
+        Page page;
+        int32_t shelfCount = 0;
+        int32_t slotCount = 0;
+        if (!readInt(data, size, offset, page.nextShelfY) || !readInt(data, size, offset, shelfCount) ||
+            !readInt(data, size, offset, slotCount) || shelfCount < 0 || slotCount < 0 || page.nextShelfY < 0 ||
+            page.nextShelfY > pageSize_)
+            break;
+        // 壊れた件数で大きな領域を確保しないよう、残りのデータに収まる件数か先に確かめる
+        const size_t layoutBytes =
+            (static_cast<size_t>(shelfCount) * 3 + static_cast<size_t>(slotCount) * 4) * sizeof(int32_t);
+        if (layoutBytes > size - offset)
+            break;
+        page.shelves.resize(shelfCount);
+        page.freeSlots.resize(slotCount);
+
+        // 棚と空き領域は allocate() がそのまま書き込み位置に使うので、全てページの内側にあることを確かめる
+        bool ok = true;
+        for (Shelf &shelf : page.shelves)
+        {
+            ok = ok && readInt(data, size, offset, shelf.y) && readInt(data, size, offset, shelf.height) &&
+                 readInt(data, size, offset, shelf.x) && shelf.height > 0 && shelf.y >= 0 &&
+                 shelf.y <= page.nextShelfY && shelf.height <= page.nextShelfY - shelf.y && shelf.x >= 0 &&
+                 shelf.x <= pageSize_;
+        }
+        for (FreeSlot &slot : page.freeSlots)
+        {
+            ok = ok && readInt(data, size, offset, slot.x) && readInt(data, size, offset, slot.y) &&
+                 readInt(data, size, offset, slot.width) && readInt(data, size, offset, slot.height) &&
+                 slot.width > 0 && slot.height > 0 && isInsidePage(slot.x, slot.y, slot.width, slot.height);
+        }
+        if (!ok || offset + pageBytes > size)
+            break;
+
+        // 画素は読み込み元からそのままテクスチャへ転送する
+        if (!addPage(data + offset))
+            break;
+        offset += pageBytes;
+        pages_.back().shelves.swap(page.shelves);
+        pages_.back().freeSlots.swap(page.freeSlots);
+        pages_.back().nextShelfY = page.nextShelfY;
+    }
+
+    if (static_cast<int32_t>(pages_.size()) != pageCount)
+    {
+        shutdown();
+        return false;
+    }
+    outConsumed = offset;
+    return true;
+}
+
+bool GlyphAtlas::allocate(Page &page, int width, int height, int &outX, int &outY, int &outSlotWidth, int &outSlotHeight)
+{
+    const int reservedWidth = width + gutter_;
+    const int reservedHeight = height + gutter_;
+
+    // 解放済みの枠のうち、収まる最小のものを優先して再利用する
+    int bestSlot = -1;
+    for (int i = 0; i < static_cast<int>(page.freeSlots.size()); ++i)
+    {
+        const FreeSlot &slot = page.freeSlots[i];
+        if (slot.width >= reservedWidth && slot.height >= reservedHeight &&
+            (bestSlot < 0 || slot.width * slot.height < page.freeSlots[bestSlot].width * page.freeSlots[bestSlot].height))
+        {
+            bestSlot = i;
+        }
+    }
+    if (bestSlot >= 0)
+    {
+        const FreeSlot slot = page.freeSlots[bestSlot];
+        page.freeSlots.erase(page.freeSlots.begin() + bestSlot);
+
+        // 余りが十分に大きければ、右と下を別の空き領域として切り分ける（長い方の余りを大きく残す）
+        const int minFree = kMinFreeSlotSize + gutter_;
+        const int usedWidth = slot.width - reservedWidth < minFree ? slot.width : reservedWidth;
+        const int usedHeight = slot.height - reservedHeight < minFree ? slot.height : reservedHeight;
+        const int rightWidth = slot.width - usedWidth;
+        const int bottomHeight = slot.height - usedHeight;
+        const bool rightTakesFullHeight = rightWidth > bottomHeight;
+        if (rightWidth > 0)
+        {
+            const int height = rightTakesFullHeight ? slot.height : usedHeight;
+            page.freeSlots.push_back({slot.x + usedWidth, slot.y, rightWidth, height});
+        }
+        if (bottomHeight > 0)
+        {
+            const int width = rightTakesFullHeight ? usedWidth : slot.width;
+            page.freeSlots.push_back({slot.x, slot.y + usedHeight, width, bottomHeight});
+        }
+
+        outX = slot.x;
+        outY = slot.y;
+        outSlotWidth = usedWidth;
+        outSlotHeight = usedHeight;
+        return true;
+    }
+
+    // 収まる棚のうち、最も低い棚を選んで縦方向の無駄を減らす
+    Shelf *best = nullptr;
+    for (Shelf &shelf : page.shelves)
+    {
+        if (shelf.height >= reservedHeight && shelf.x + reservedWidth <= pageSize_ &&
+            (!best || shelf.height < best->height))
+        {
+            best = &shelf;
+        }
+    }
+
+    if (!best)
+    {
+        if (page.nextShelfY + reservedHeight > pageSize_)
+            return false;
+        Shelf shelf;
+        shelf.y = page.nextShelfY;
+        shelf.height = reservedHeight;
+        page.shelves.push_back(shelf);
+        page.nextShelfY += reservedHeight;
+        best = &page.shelves.back();
+    }
+
+    outX = best->x;
+    outY = best->y;
+    outSlotWidth = reservedWidth;
+    outSlotHeight = best->height;
+    best->x += reservedWidth;
+    return true;
+}
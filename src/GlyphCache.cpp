@@ -0,0 +1,165 @@
+#include "GlyphCache.h"
+
+namespace
+{
+    // キーの下位ビットは文字コードなので、偏りが無くなるよう全ビットを混ぜてから添字にする
+    size_t hashKey(GlyphCache::Key key)
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ull;
+        key ^= key >> 33;
+        return static_cast<size_t>(key);
+    }
+}
+
+size_t GlyphCache::findSlot(Key key) const
+{
+    // キーのある位置、無ければ空きの位置を返す（table_ は空でないこと）
+    const size_t mask = table_.size() - 1;
+    size_t slot = hashKey(key) & mask;
+    while (table_[slot] != kNone && nodes_[table_[slot]].key != key)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+uint32_t GlyphCache::findIndex(Key key) const
+{
+    return table_.empty() ? kNone : table_[findSlot(key)];
+}
+
+void GlyphCache::grow()
+{
+    // 使用率を 3/4 以下に保つ
+    const size_t capacity = table_.empty() ? 64 : table_.size() * 2;
+    table_.assign(capacity, kNone);
+    for (uint32_t index = 0; index < nodes_.size(); ++index)
+        table_[findSlot(nodes_[index].key)] = index;
+}
+
+void GlyphCache::unlink(uint32_t index)
+{
+    Node &node = nodes_[index];
+    if (node.prev != kNone)
+        nodes_[node.prev].next = node.next;
+    else
+        head_ = node.next;
+    if (node.next != kNone)
+        nodes_[node.next].prev = node.prev;
+    else
+        tail_ = node.prev;
+}
+
+void GlyphCache::pushFront(uint32_t index)
+{
+    Node &node = nodes_[index];
+    node.prev = kNone;
+    node.next = head_;
+    if (head_ != kNone)
+        nodes_[head_].prev = index;
+    head_ = index;
+    if (tail_ == kNone)
+        tail_ = index;
+}
+
+uint32_t GlyphCache::erase(uint32_t index)
+{
+    unlink(index);
+
+    // 線形探査の並びが途切れないよう、後続のキーを空いた位置へ詰める（墓標を残さない）
+    const size_t mask = table_.size() - 1;
+    size_t hole = findSlot(nodes_[index].key);
+    for (size_t slot = (hole + 1) & mask; table_[slot] != kNone; slot = (slot + 1) & mask)
+    {
+        const size_t home = hashKey(nodes_[table_[slot]].key) & mask;
+        // home が (hole, slot] の範囲（循環）に無いものだけが hole へ移れる
+        if (((slot - home) & mask) >= ((slot - hole) & mask))
+        {
+            table_[hole] = table_[slot];
+            hole = slot;
+        }
+    }
+    table_[hole] = kNone;
+
+    // 配列を詰めたままにするため、末尾のノードを空いた位置へ移す
+    const uint32_t last = static_cast<uint32_t>(nodes_.size() - 1);
+    if (index != last)
+    {
+        Node &moved = nodes_[index];
+        moved = nodes_[last];
+        table_[findSlot(moved.key)] = index;
+        if (moved.prev != kNone)
+            nodes_[moved.prev].next = index;
+        else
+            head_ = index;
+        if (moved.next != kNone)
+            nodes_[moved.next].prev = index;
+        else
+            tail_ = index;
+    }
+    nodes_.pop_back();
+    return index != last ? last : kNone;
+}
+
+const GlyphCache::Glyph *GlyphCache::find(Key key) const
+{
+    const uint32_t index = findIndex(key);
+    return index != kNone ? &nodes_[index].glyph : nullptr;
+}
+
+const GlyphCache::Glyph *GlyphCache::lookup(Key key)
+{
+    const uint32_t index = findIndex(key);
+    if (index == kNone)
+    {
+        stats_.misses++;
+        return nullptr;
+    }
+    stats_.hits++;
+    unlink(index);
+    pushFront(index);
+    return &nodes_[index].glyph;
+}
+
+void GlyphCache::touch(Key key)
+{
+    const uint32_t index = findIndex(key);
+    if (index == kNone)
+        return;
+    unlink(index);
+    pushFront(index);
+}
+
+void GlyphCache::insert(Key key, const Glyph &glyph)
+{
+    const uint32_t found = findIndex(key);
+    if (found != kNone)
+    {
+        nodes_[found].glyph = glyph;
+        unlink(found);
+        pushFront(found);
+        return;
+    }
+    if ((nodes_.size() + 1) * 4 > table_.size() * 3)
+        grow();
+    const uint32_t index = static_cast<uint32_t>(nodes_.size());
+    nodes_.push_back(Node{key, glyph, kNone, kNone});
+    table_[findSlot(key)] = index;
+    pushFront(index);
+}
+
+void GlyphCache::clear()
+{
+    nodes_.clear();
+    table_.clear();
+    head_ = kNone;
+    tail_ = kNone;
+}
+
+GlyphCache::Stats GlyphCache::getStats() const
+{
+    Stats stats = stats_;
+    stats.glyphs = nodes_.size();
+    return stats;
+}
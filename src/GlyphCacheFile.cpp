@@ -0,0 +1,307 @@
+#include "GlyphCacheFile.h"
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr char kMagic[8] = {'R', 'G', 'L', 'G', 'L', 'Y', 'P', 'H'};
+    // 形式を変えたら上げる
+    constexpr uint32_t kVersion = 2;
+
+    // ヘッダ: マジック、バージョン、フォント数、アトラスとSDFの設定、ヘッダ以降の検査値。
+    // 続いてフォントの識別値、グリフ数
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t fontCount;
+        int32_t pageSize;
+        int32_t gutter;
+        int32_t sdfBaseSize;
+        int32_t sdfSpread;
+        uint64_t checksum;
+    };
+
+    // グリフ1つ分。UVは読み込み時に位置とページの大きさから求め直す
+    struct GlyphRecord
+    {
+        uint64_t key;
+        int32_t page;
+        int32_t x;
+        int32_t y;
+        int32_t regionWidth;
+        int32_t regionHeight;
+        int32_t slotWidth;
+        int32_t slotHeight;
+        int32_t width;
+        int32_t height;
+        int32_t bearingX;
+        int32_t bearingY;
+        int32_t advance;
+    };
+
+    uint64_t fnv1a(uint64_t hash, const void *data, size_t size)
+    {
+        const uint8_t *bytes = static_cast<const uint8_t *>(data);
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // ヘッダ以降の内容の検査値。起動を遅らせないよう、8バイトずつ混ぜる
+    uint64_t computeChecksum(const uint8_t *data, size_t size)
+    {
+        uint64_t hash = 14695981039346656037ull ^ size;
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            std::memcpy(&word, data + i, sizeof(word));
+            hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+            hash ^= hash >> 29;
+        }
+        return fnv1a(hash, data + i, size - i);
+    }
+
+    // 書き終えたファイルの検査値を求めてヘッダに書き込む
+    bool writeChecksum(const std::string &path)
+    {
+        int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(FileHeader);
+        if (ok)
+        {
+            const size_t size = static_cast<size_t>(st.st_size);
+            void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            ok = mapped != MAP_FAILED;
+            if (ok)
+            {
+                const uint64_t value = computeChecksum(static_cast<const uint8_t *>(mapped) + sizeof(FileHeader),
+                                                       size - sizeof(FileHeader));
+                munmap(mapped, size);
+                ok = pwrite(fd, &value, sizeof(value), offsetof(FileHeader, checksum)) ==
+                     static_cast<ssize_t>(sizeof(value));
+            }
+        }
+        ok = close(fd) == 0 && ok;
+        return ok;
+    }
+
+    template <typename T>
+    bool readValue(const uint8_t *data, size_t size, size_t &offset, T &value)
+    {
+        if (offset + sizeof(T) > size)
+            return false;
+        std::memcpy(&value, data + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+}
+
+uint64_t GlyphCacheFile::hashFont(const std::string &path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return 0;
+
+    uint64_t hash = 14695981039346656037ull;
+    hash = fnv1a(hash, path.data(), path.size());
+    const int64_t fields[3] = {static_cast<int64_t>(st.st_size), static_cast<int64_t>(st.st_mtim.tv_sec),
+                               static_cast<int64_t>(st.st_mtim.tv_nsec)};
+    return fnv1a(hash, fields, sizeof(fields));
+}
+
+bool GlyphCacheFile::load(const std::string &path, const Identity &identity, GlyphAtlas &atlas, GlyphCache &cache)
+{
+    cache.clear();
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        std::cout << "[GlyphCacheFile] No cache file at " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        close(fd);
+        return false;
+    }
+    const size_t size = static_cast<size_t>(st.st_size);
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        std::cerr << "[GlyphCacheFile] Failed to map " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    const uint8_t *data = static_cast<const uint8_t *>(mapped);
+
+    bool ok = false;
+    size_t offset = 0;
+    FileHeader header;
+    if (!readValue(data, size, offset, header) || std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+        header.version != kVersion)
+    {
+        std::cerr << "[GlyphCacheFile] " << path << " is not a glyph cache file of version " << kVersion << "." << std::endl;
+    }
+    else if (computeChecksum(data + offset, size - offset) != header.checksum)
+    {
+        std::cerr << "[GlyphCacheFile] " << path << " is corrupt (checksum mismatch). Ignoring it." << std::endl;
+    }
+    else if (header.fontCount != identity.fontHashes.size() || header.pageSize != identity.pageSize ||
+             header.gutter != identity.gutter || header.sdfBaseSize != identity.sdfBaseSize ||
+             header.sdfSpread != identity.sdfSpread)
+    {
+        std::cout << "[GlyphCacheFile] " << path << " was made with different settings. Ignoring it." << std::endl;
+    }
+    else
+    {
+        bool fontsMatch = true;
+        for (uint64_t expected : identity.fontHashes)
+        {
+            uint64_t hash = 0;
+            fontsMatch = fontsMatch && readValue(data, size, offset, hash) && hash == expected && hash != 0;
+        }
+        uint32_t glyphCount = 0;
+        const size_t recordsOffset = offset + sizeof(glyphCount);
+        if (!fontsMatch)
+        {
+            std::cout << "[GlyphCacheFile] Fonts changed since " << path << " was saved. Ignoring it." << std::endl;
+        }
+        else if (!readValue(data, size, offset, glyphCount) ||
+                 recordsOffset + static_cast<size_t>(glyphCount) * sizeof(GlyphRecord) > size)
+        {
+            std::cerr << "[GlyphCacheFile] " << path << " is truncated." << std::endl;
+        }
+        else
+        {
+            // 先にアトラスを読み込んでから、その上の位置を指すグリフを登録する
+            size_t atlasBytes = 0;
+            offset = recordsOffset + static_cast<size_t>(glyphCount) * sizeof(GlyphRecord);
+            if (atlas.load(data + offset, size - offset, atlasBytes))
+            {
+                const float scale = 1.0f / atlas.getPageSize();
+                ok = true;
+                offset = recordsOffset;
+                for (uint32_t i = 0; i < glyphCount && ok; ++i)
+                {
+                    GlyphRecord record;
+                    readValue(data, size, offset, record);
+                    GlyphCache::Glyph glyph;
+                    glyph.region.page = record.page;
+                    glyph.region.x = record.x;
+                    glyph.region.y = record.y;
+                    glyph.region.width = record.regionWidth;
+                    glyph.region.height = record.regionHeight;
+                    glyph.region.u0 = record.x * scale;
+                    glyph.region.v0 = record.y * scale;
+                    glyph.region.u1 = (record.x + record.regionWidth) * scale;
+                    glyph.region.v1 = (record.y + record.regionHeight) * scale;
+                    glyph.region.slotWidth = record.slotWidth;
+                    glyph.region.slotHeight = record.slotHeight;
+                    glyph.width = record.width;
+                    glyph.height = record.height;
+                    glyph.bearingX = record.bearingX;
+                    glyph.bearingY = record.bearingY;
+                    glyph.advance = record.advance;
+                    // 領域はテクスチャの書き込みや解放にそのまま使うので、ページの内側にあるものだけ受け付ける
+                    if (!atlas.isValidRegion(glyph.region) || glyph.width != glyph.region.width ||
+                        glyph.height != glyph.region.height)
+                    {
+                        ok = false;
+                        break;
+                    }
+                    // 保存時は古い順に並べているので、この順に登録すれば LRU の順序も戻る
+                    cache.insert(record.key, glyph);
+                }
+            }
+            if (!ok)
+                std::cerr << "[GlyphCacheFile] " << path << " is corrupt." << std::endl;
+        }
+    }
+
+    munmap(mapped, size);
+    if (!ok)
+    {
+        cache.clear();
+        atlas.shutdown();
+        return false;
+    }
+    std::cout << "[GlyphCacheFile] Loaded " << cache.getStats().glyphs << " glyphs in " << atlas.getPageCount()
+              << " page(s) from " << path << std::endl;
+    return true;
+}
+
+bool GlyphCacheFile::save(const std::string &path, const Identity &identity, const GlyphAtlas &atlas, const GlyphCache &cache)
+{
+    // 書き込み途中のファイルを読まれないよう、一時ファイルに書いてから置き換える
+    const std::string temporaryPath = path + ".tmp";
+    std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        std::cerr << "[GlyphCacheFile] Failed to open " << temporaryPath << " for writing." << std::endl;
+        return false;
+    }
+
+    FileHeader header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.fontCount = static_cast<uint32_t>(identity.fontHashes.size());
+    header.pageSize = identity.pageSize;
+    header.gutter = identity.gutter;
+    header.sdfBaseSize = identity.sdfBaseSize;
+    header.sdfSpread = identity.sdfSpread;
+    // 検査値は書き終えてから埋める
+    header.checksum = 0;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(identity.fontHashes.data()), identity.fontHashes.size() * sizeof(uint64_t));
+
+    std::vector<GlyphRecord> records;
+    records.reserve(cache.getStats().glyphs);
+    cache.forEachLeastRecentFirst([&records](GlyphCache::Key key, const GlyphCache::Glyph &glyph) {
+        GlyphRecord record;
+        record.key = key;
+        record.page = glyph.region.page;
+        record.x = glyph.region.x;
+        record.y = glyph.region.y;
+        record.regionWidth = glyph.region.width;
+        record.regionHeight = glyph.region.height;
+        record.slotWidth = glyph.region.slotWidth;
+        record.slotHeight = glyph.region.slotHeight;
+        record.width = glyph.width;
+        record.height = glyph.height;
+        record.bearingX = glyph.bearingX;
+        record.bearingY = glyph.bearingY;
+        record.advance = glyph.advance;
+        records.push_back(record);
+    });
+    const uint32_t glyphCount = static_cast<uint32_t>(records.size());
+    out.write(reinterpret_cast<const char *>(&glyphCount), sizeof(glyphCount));
+    out.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(GlyphRecord));
+
+    const bool ok = atlas.save(out) && out.flush();
+    out.close();
+    if (!ok || !writeChecksum(temporaryPath) || std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+    {
+        std::cerr << "[GlyphCacheFile] Failed to write " << path << std::endl;
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+    std::cout << "[GlyphCacheFile] Saved " << glyphCount << " glyphs in " << atlas.getPageCount() << " page(s) to "
+              << path << std::endl;
+    return true;
+}
@@ -0,0 +1,263 @@
+#include "GlyphRasterizer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+    // ワーカー1つあたりの結果キューの容量。描画スレッドが受け取るまでの間に溜められる数
+    constexpr size_t kResultQueueCapacity = 256;
+
+    /// @brief 1次元の二乗距離変換 (Felzenszwalb & Huttenlocher)。f を入力とし、結果を d に書き込む
+    void distanceTransform1D(const float *f, int n, float *d, int *v, float *z)
+    {
+        const float inf = 1e20f;
+        int k = 0;
+        v[0] = 0;
+        z[0] = -inf;
+        z[1] = inf;
+        for (int q = 1; q < n; ++q)
+        {
+            float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * q - 2.0f * v[k]);
+            while (s <= z[k])
+            {
+                --k;
+                s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * q - 2.0f * v[k]);
+            }
+            ++k;
+            v[k] = q;
+            z[k] = s;
+            z[k + 1] = inf;
+        }
+        k = 0;
+        for (int q = 0; q < n; ++q)
+        {
+            while (z[k + 1] < q)
+                ++k;
+            d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+        }
+    }
+
+    /// @brief grid (0: 特徴点, 無限大: それ以外) を、最も近い特徴点までの二乗距離に置き換える
+    void distanceTransform2D(std::vector<float> &grid, int width, int height)
+    {
+        const int n = std::max(width, height);
+        std::vector<float> f(n), d(n), z(n + 1);
+        std::vector<int> v(n);
+        for (int x = 0; x < width; ++x)
+        {
+            for (int y = 0; y < height; ++y)
+                f[y] = grid[y * width + x];
+            distanceTransform1D(f.data(), height, d.data(), v.data(), z.data());
+            for (int y = 0; y < height; ++y)
+                grid[y * width + x] = d[y];
+        }
+        for (int y = 0; y < height; ++y)
+        {
+            distanceTransform1D(&grid[y * width], width, d.data(), v.data(), z.data());
+            std::copy(d.begin(), d.begin() + width, grid.begin() + y * width);
+        }
+    }
+
+    /**
+     * @brief α画像を符号付き距離場に置き換える。
+     * 輪郭上を 128、内側へ spread ピクセルで 255、外側へ spread ピクセルで 0 となるように符号化する。
+     */
+    void buildSignedDistanceField(std::vector<unsigned char> &pixels, int width, int height, int spread)
+    {
+        const float inf = 1e20f;
+        const size_t count = static_cast<size_t>(width) * height;
+        std::vector<float> toInside(count);  // 外側の画素から最も近い内側の画素まで
+        std::vector<float> toOutside(count); // 内側の画素から最も近い外側の画素まで
+        for (size_t i = 0; i < count; ++i)
+        {
+            const bool inside = pixels[i] >= 128;
+            toInside[i] = inside ? 0.0f : inf;
+            toOutside[i] = inside ? inf : 0.0f;
+        }
+        distanceTransform2D(toInside, width, height);
+        distanceTransform2D(toOutside, width, height);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            // 画素の中心同士の距離なので、境界までは半ピクセル短い
+            float distance = pixels[i] >= 128 ? std::sqrt(toOutside[i]) - 0.5f : -(std::sqrt(toInside[i]) - 0.5f);
+            float value = 0.5f + distance / (2.0f * spread);
+            pixels[i] = static_cast<unsigned char>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+        }
+    }
+}
+
+GlyphRasterizer::GlyphRasterizer()
+{
+}
+
+GlyphRasterizer::~GlyphRasterizer()
+{
+    stop();
+}
+
+bool GlyphRasterizer::start(const std::vector<std::string> &fontPaths, int workerCount)
+{
+    stop();
+    stopping_ = false;
+
+    const int count = std::max(workerCount, 1);
+    for (int i = 0; i < count; ++i)
+    {
+        std::unique_ptr<Worker> worker(new Worker());
+        Worker &w = *worker;
+        workers_.push_back(std::move(worker));
+        if (FT_Init_FreeType(&w.library) != 0)
+        {
+            std::cerr << "[GlyphRasterizer] Failed to initialize FreeType library." << std::endl;
+            stop();
+            return false;
+        }
+        for (const std::string &path : fontPaths)
+        {
+            FT_Face face = nullptr;
+            if (FT_New_Face(w.library, path.c_str(), 0, &face) != 0)
+            {
+                std::cerr << "[GlyphRasterizer] Failed to load font: " << path << std::endl;
+                stop();
+                return false;
+            }
+            w.faces.push_back(face);
+            w.pixelSizes.push_back(0);
+        }
+        w.results.reset(kResultQueueCapacity);
+    }
+
+    for (std::unique_ptr<Worker> &worker : workers_)
+    {
+        Worker *w = worker.get();
+        worker->thread = std::thread([this, w]()
+                                     { workerLoop(*w); });
+    }
+    std::cout << "[GlyphRasterizer] Started " << workers_.size() << " worker(s) with " << fontPaths.size()
+              << " font(s)" << std::endl;
+    return true;
+}
+
+void GlyphRasterizer::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex_);
+        stopping_ = true;
+        jobs_.clear();
+    }
+    jobsCondition_.notify_all();
+
+    for (std::unique_ptr<Worker> &worker : workers_)
+    {
+        if (worker->thread.joinable())
+            worker->thread.join();
+        for (FT_Face face : worker->faces)
+            FT_Done_Face(face);
+        if (worker->library)
+            FT_Done_FreeType(worker->library);
+    }
+    workers_.clear();
+    nextPoll_ = 0;
+}
+
+bool GlyphRasterizer::isRunning() const
+{
+    return !workers_.empty();
+}
+
+void GlyphRasterizer::request(const Request &request)
+{
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex_);
+        jobs_.push_back(request);
+    }
+    jobsCondition_.notify_one();
+}
+
+bool GlyphRasterizer::poll(Result &out)
+{
+    // 特定のワーカーの結果ばかり先に受け取らないよう、前回の続きから巡回する
+    for (size_t i = 0; i < workers_.size(); ++i)
+    {
+        Worker &worker = *workers_[(nextPoll_ + i) % workers_.size()];
+        if (worker.results.pop(out))
+        {
+            nextPoll_ = (nextPoll_ + i + 1) % workers_.size();
+            return true;
+        }
+    }
+    return false;
+}
+
+void GlyphRasterizer::workerLoop(Worker &worker)
+{
+    while (true)
+    {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(jobsMutex_);
+            jobsCondition_.wait(lock, [this]()
+                                { return stopping_ || !jobs_.empty(); });
+            if (stopping_)
+                return;
+            request = jobs_.front();
+            jobs_.pop_front();
+        }
+
+        Result result;
+        rasterize(worker, request, result);
+
+        // 結果キューが一杯なら、描画スレッドが受け取るまで待つ
+        while (!worker.results.push(std::move(result)))
+        {
+            if (stopping_)
+                return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+void GlyphRasterizer::rasterize(Worker &worker, const Request &request, Result &result)
+{
+    result.request = request;
+    if (request.face < 0 || request.face >= static_cast<int>(worker.faces.size()))
+        return;
+    FT_Face face = worker.faces[request.face];
+    if (worker.pixelSizes[request.face] != request.pixelSize)
+    {
+        FT_Set_Pixel_Sizes(face, 0, request.pixelSize);
+        worker.pixelSizes[request.face] = request.pixelSize;
+    }
+    if (FT_Load_Char(face, request.code, FT_LOAD_RENDER))
+        return;
+
+    FT_GlyphSlot g = face->glyph;
+    const int originalWidth = g->bitmap.width;
+    const int originalHeight = g->bitmap.rows;
+    const int padding = request.padding;
+
+    result.width = originalWidth + padding * 2;
+    result.height = originalHeight + padding * 2;
+    result.pixels.assign(static_cast<size_t>(result.width) * result.height, 0);
+
+    // 中央にビットマップを配置（行単位でコピー）
+    for (int row = 0; row < originalHeight; ++row)
+    {
+        std::memcpy(&result.pixels[(row + padding) * result.width + padding],
+                    &g->bitmap.buffer[row * g->bitmap.pitch],
+                    originalWidth);
+    }
+    if (request.format == Format::SDF)
+    {
+        buildSignedDistanceField(result.pixels, result.width, result.height, request.sdfSpread);
+    }
+
+    result.bearingX = g->bitmap_left - padding;
+    result.bearingY = g->bitmap_top + padding;
+    result.advance = static_cast<int>(g->advance.x >> 6);
+    result.ok = true;
+}
@@ -1,12 +1,20 @@
 #include "GraphicsPlatform.h"
+#include "TraceRecorder.h"
 #include <iostream>
 #include <vector>
 #include <fcntl.h>  // open
 #include <unistd.h> // close
+#include <poll.h>   // poll
+#include <cerrno>
+#include <csignal>
+#include <cstring>
 #include <fstream>
+#include <thread>
 #include <png.h>
 #include <GLES2/gl2.h>
 
+thread_local GraphicsPlatform *GraphicsPlatform::event_target_ = nullptr;
+
 GraphicsPlatform::GraphicsPlatform() {}
 GraphicsPlatform::~GraphicsPlatform()
 {
@@ -20,8 +28,17 @@ GraphicsPlatform::~GraphicsPlatform()
 /// @return
 bool GraphicsPlatform::initialize()
 {
-    // 1. 利用可能なDRMデバイスを開く
-    const std::vector<std::string> drm_devices = {"/dev/dri/card0", "/dev/dri/card1"};
+    if (backend_ == Backend::Headless)
+    {
+        return initializeHeadless();
+    }
+
+    // 1. 利用可能なDRMデバイスを開く（パス指定があればそれだけを試す）
+    std::vector<std::string> drm_devices = {"/dev/dri/card0", "/dev/dri/card1"};
+    if (!drm_device_path_.empty())
+    {
+        drm_devices = {drm_device_path_};
+    }
     for (const auto &device_path : drm_devices)
     {
         drm_fd_ = open(device_path.c_str(), O_RDWR);
@@ -87,6 +104,15 @@ bool GraphicsPlatform::initialize()
         std::cerr << "Error: No modes available for the connector." << std::endl;
         return false;
     }
+    updateRefreshInterval();
+
+    // フリップ完了イベントのタイムスタンプを表示時刻の予測に使えるか確認する
+    uint64_t monotonic = 0;
+    monotonic_timestamps_ = drmGetCap(drm_fd_, DRM_CAP_TIMESTAMP_MONOTONIC, &monotonic) == 0 && monotonic != 0;
+    if (!monotonic_timestamps_)
+    {
+        std::cerr << "[GraphicsPlatform] Flip timestamps are not monotonic. Presentation time prediction uses the current time." << std::endl;
+    }
 
     // 4. コネクタに合ったエンコーダとCRTCを探す
     drmModeEncoder *encoder = nullptr;
@@ -194,10 +220,239 @@ bool GraphicsPlatform::initialize()
         return false;
     }
 
-    std::cout << "Graphics platform initialized successfully." << std::endl;
+    std::cout << "Graphics platform initialized successfully ("
+              << (present_mode_ == PresentMode::PageFlip ? "page flip" : "set crtc") << " mode)." << std::endl;
     return true;
 }
 
+/// @brief ヘッドレスバックエンドを初期化する
+/// @note DRMデバイスやコネクタを使わず、EGL surfaceless プラットフォーム（無ければ既定のディスプレイ）の
+///       pbuffer を描画先にします。画面の大きさとリフレッシュ間隔は setHeadlessMode() の値を表示モードとして扱います。
+bool GraphicsPlatform::initializeHeadless()
+{
+    mode_info_ = drmModeModeInfo();
+    mode_info_.hdisplay = static_cast<uint16_t>(headless_width_);
+    mode_info_.vdisplay = static_cast<uint16_t>(headless_height_);
+    mode_info_.vrefresh = static_cast<uint32_t>(headless_refresh_hz_);
+    updateRefreshInterval();
+    // 仮想の垂直同期の時刻は steady_clock で決めるので、表示時刻の予測にそのまま使える
+    monotonic_timestamps_ = true;
+
+    display_ = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (display_ == EGL_NO_DISPLAY)
+    {
+        display_ = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (display_ == EGL_NO_DISPLAY || eglInitialize(display_, NULL, NULL) == EGL_FALSE)
+    {
+        std::cerr << "[GraphicsPlatform] Failed to initialize a headless EGL display." << std::endl;
+        return false;
+    }
+
+    const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+        EGL_NONE};
+    EGLint num_configs = 0;
+    if (!eglChooseConfig(display_, config_attribs, &config_, 1, &num_configs) || num_configs == 0)
+    {
+        std::cerr << "[GraphicsPlatform] No pbuffer capable EGL config." << std::endl;
+        return false;
+    }
+
+    const EGLint pbuffer_attribs[] = {EGL_WIDTH, headless_width_, EGL_HEIGHT, headless_height_, EGL_NONE};
+    surface_ = eglCreatePbufferSurface(display_, config_, pbuffer_attribs);
+    if (surface_ == EGL_NO_SURFACE)
+    {
+        std::cerr << "[GraphicsPlatform] Failed to create EGL pbuffer surface." << std::endl;
+        return false;
+    }
+
+    const EGLint context_attribs[] = {EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE};
+    context_ = eglCreateContext(display_, config_, EGL_NO_CONTEXT, context_attribs);
+    if (context_ == EGL_NO_CONTEXT || eglMakeCurrent(display_, surface_, surface_, context_) == EGL_FALSE)
+    {
+        std::cerr << "[GraphicsPlatform] Failed to create EGL context." << std::endl;
+        return false;
+    }
+
+    if (!frame_sink_path_.empty())
+    {
+        // FIFO は読み手が開くまで待ってから、描画ループを止めないよう書き込みをノンブロッキングにする
+        // （O_NONBLOCK で開くと、読み手がいない FIFO は ENXIO で開けない）
+        frame_sink_fd_ = open(frame_sink_path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (frame_sink_fd_ < 0 || fcntl(frame_sink_fd_, F_SETFL, fcntl(frame_sink_fd_, F_GETFL) | O_NONBLOCK) != 0)
+        {
+            std::cerr << "[GraphicsPlatform] Failed to open frame sink " << frame_sink_path_ << ": "
+                      << std::strerror(errno) << std::endl;
+            return false;
+        }
+        sink_frame_.clear();
+        sink_written_ = 0;
+        sink_dropped_frames_ = 0;
+        std::cout << "[GraphicsPlatform] Writing " << headless_width_ << "x" << headless_height_
+                  << " RGBA frames to " << frame_sink_path_ << std::endl;
+    }
+
+    std::cout << "Graphics platform initialized successfully (headless " << headless_width_ << "x" << headless_height_
+              << ", " << glGetString(GL_RENDERER) << ", "
+              << (present_mode_ == PresentMode::PageFlip ? "paced to " + std::to_string(headless_refresh_hz_) + " Hz"
+                                                         : std::string("unthrottled"))
+              << ")." << std::endl;
+    return true;
+}
+
+/// @brief 書き出し中のフレームの残りを、シンクがブロックせずに受け取れる分だけ書き込む
+/// @note 読み手が先に終了した FIFO へ書くと SIGPIPE が届くので、書き込みの間だけこのスレッドで SIGPIPE を
+///       ブロックし、届いていれば取り除いてから元に戻す（プロセス全体のシグナルの設定は変えない）。
+/// @return シンクが使える場合はtrue。書き込みに失敗した場合はシンクを閉じてfalse
+bool GraphicsPlatform::writeFrameSink()
+{
+    sigset_t pipe_set;
+    sigset_t old_set;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+
+    int error = 0;
+    while (sink_written_ < sink_frame_.size())
+    {
+        const ssize_t result =
+            write(frame_sink_fd_, sink_frame_.data() + sink_written_, sink_frame_.size() - sink_written_);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (result <= 0)
+        {
+            error = result < 0 ? errno : EIO;
+            break;
+        }
+        sink_written_ += static_cast<size_t>(result);
+    }
+
+    if (error == EPIPE)
+    {
+        // 書き込みで届いた SIGPIPE を取り除いておく（元からブロックされていた場合は呼び出し側に任せる）
+        sigset_t pending;
+        sigpending(&pending);
+        const struct timespec no_wait = {0, 0};
+        if (!sigismember(&old_set, SIGPIPE) && sigismember(&pending, SIGPIPE))
+            sigtimedwait(&pipe_set, nullptr, &no_wait);
+    }
+    pthread_sigmask(SIG_SETMASK, &old_set, nullptr);
+
+    if (error != 0)
+    {
+        std::cerr << "[GraphicsPlatform] Failed to write to frame sink: " << std::strerror(error)
+                  << ". Frames are no longer written." << std::endl;
+        close(frame_sink_fd_);
+        frame_sink_fd_ = -1;
+        return false;
+    }
+    return true;
+}
+
+/// @brief ヘッドレスバックエンドでフレームを表示する
+/// @note シンクがあれば描画結果を読み出して書き込みます。PageFlipモードでは、直前の表示の次の仮想垂直同期
+///       （間に合わなければさらに次）まで待ち、その時刻を表示時刻として記録します。
+void GraphicsPlatform::presentHeadless()
+{
+    if (frame_sink_fd_ >= 0)
+    {
+        TRACE_SCOPE("frame_sink");
+        // 前のフレームを書き終えていなければ続きを書き、それでも残るならこのフレームは書き出さない
+        if (sink_written_ < sink_frame_.size() && writeFrameSink() && sink_written_ < sink_frame_.size())
+        {
+            if (sink_dropped_frames_++ == 0)
+                std::cerr << "[GraphicsPlatform] Frame sink is not keeping up. Dropping frames." << std::endl;
+            TRACE_INSTANT("frame_sink_drop", "dropped", sink_dropped_frames_);
+        }
+        else if (frame_sink_fd_ >= 0)
+        {
+            const size_t row_bytes = static_cast<size_t>(headless_width_) * 4;
+            sink_pixels_.resize(row_bytes * headless_height_);
+            sink_frame_.resize(sink_pixels_.size());
+            glReadPixels(0, 0, headless_width_, headless_height_, GL_RGBA, GL_UNSIGNED_BYTE, sink_pixels_.data());
+            // glReadPixels は下の行から並ぶので、上の行から順に並べ替える
+            for (int y = 0; y < headless_height_; ++y)
+            {
+                std::memcpy(&sink_frame_[y * row_bytes], &sink_pixels_[(headless_height_ - 1 - y) * row_bytes], row_bytes);
+            }
+            sink_written_ = 0;
+            writeFrameSink();
+        }
+    }
+    else
+    {
+        // pbuffer では eglSwapBuffers() は何もしないので、描画コマンドの発行だけを促す
+        glFlush();
+    }
+
+    if (present_mode_ != PresentMode::PageFlip)
+    {
+        return;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    auto vblank = has_flip_time_ ? last_flip_time_ + refresh_interval_ : now;
+    if (vblank < now)
+    {
+        vblank += ((now - vblank) / refresh_interval_ + 1) * refresh_interval_;
+    }
+    {
+        TRACE_SCOPE("wait_for_flip");
+        std::this_thread::sleep_until(vblank);
+    }
+    recordFlip(vblank);
+    TRACE_INSTANT("page_flip", nullptr, 0);
+}
+
+/// @brief バックエンドを設定する
+void GraphicsPlatform::setBackend(Backend backend)
+{
+    backend_ = backend;
+}
+
+GraphicsPlatform::Backend GraphicsPlatform::getBackend() const
+{
+    return backend_;
+}
+
+/// @brief ヘッドレスバックエンドの解像度とリフレッシュレートを設定する
+void GraphicsPlatform::setHeadlessMode(int width, int height, int refreshHz)
+{
+    headless_width_ = width;
+    headless_height_ = height;
+    headless_refresh_hz_ = refreshHz > 0 ? refreshHz : 60;
+}
+
+/// @brief ヘッドレスバックエンドのフレームの書き出し先を指定する
+void GraphicsPlatform::setFrameSink(const char *path)
+{
+    frame_sink_path_ = path ? path : "";
+}
+
+/// @brief 画面更新方式を設定する
+/// @param mode 画面更新方式
+void GraphicsPlatform::setPresentMode(PresentMode mode)
+{
+    present_mode_ = mode;
+}
+
+GraphicsPlatform::PresentMode GraphicsPlatform::getPresentMode() const
+{
+    return present_mode_;
+}
+
+/// @brief 使用するDRMデバイスのパスを指定する
+/// @param path デバイスパス。nullptrまたは空文字なら自動検出
+void GraphicsPlatform::setDrmDevicePath(const char *path)
+{
+    drm_device_path_ = path ? path : "";
+}
+
 /// @brief 確保したグラフィックスリソースを全て解放する
 /// @note この関数は、EGL、GBM、DRM/KMSのリソースを解放します。
 ///       swapBuffers()を呼び出す前に
@@ -207,6 +462,8 @@ bool GraphicsPlatform::initialize()
 ///       そのため、明示的に呼び出す必要はありません。
 void GraphicsPlatform::shutdown()
 {
+    // フリップ中のバッファを解放する前に、表示が切り替わるのを待つ
+    waitForPendingFlip();
     if (original_crtc_)
     {
         drmModeSetCrtc(drm_fd_, original_crtc_->crtc_id, original_crtc_->buffer_id,
@@ -230,11 +487,6 @@ void GraphicsPlatform::shutdown()
         eglTerminate(display_);
         display_ = EGL_NO_DISPLAY;
     }
-    if (previous_fb_id_ != 0)
-    {
-        drmModeRmFB(drm_fd_, previous_fb_id_);
-        previous_fb_id_ = 0;
-    }
     if (gbm_surface_)
     {
         if (previous_bo_)
@@ -242,8 +494,21 @@ void GraphicsPlatform::shutdown()
             gbm_surface_release_buffer(gbm_surface_, previous_bo_);
             previous_bo_ = nullptr;
         }
+        if (pending_bo_)
+        {
+            gbm_surface_release_buffer(gbm_surface_, pending_bo_);
+            pending_bo_ = nullptr;
+        }
+        if (stale_bo_)
+        {
+            gbm_surface_release_buffer(gbm_surface_, stale_bo_);
+            stale_bo_ = nullptr;
+        }
+        // GBMバッファの破棄に合わせて、紐付けたDRMフレームバッファもdestroyコールバックで削除される
         gbm_surface_destroy(gbm_surface_);
         gbm_surface_ = nullptr;
+        std::cout << "[GraphicsPlatform] drmModeAddFB calls: " << fb_stats_.addCalls
+                  << ", avoided by cache: " << fb_stats_.addCallsAvoided << std::endl;
     }
     if (drm_connector_)
     {
@@ -265,16 +530,52 @@ void GraphicsPlatform::shutdown()
         close(drm_fd_);
         drm_fd_ = -1;
     }
+    if (frame_sink_fd_ >= 0 && sink_written_ < sink_frame_.size())
+    {
+        // 書き出し途中のフレームは読み手を待ってでも最後まで書き、ストリームをフレームの境界で終える
+        fcntl(frame_sink_fd_, F_SETFL, fcntl(frame_sink_fd_, F_GETFL) & ~O_NONBLOCK);
+        writeFrameSink();
+    }
+    if (frame_sink_fd_ >= 0)
+    {
+        close(frame_sink_fd_);
+        frame_sink_fd_ = -1;
+    }
+    sink_frame_.clear();
+    sink_written_ = 0;
+    if (sink_dropped_frames_ > 0)
+    {
+        std::cout << "[GraphicsPlatform] Dropped " << sink_dropped_frames_ << " frame(s) while the frame sink was full."
+                  << std::endl;
+        sink_dropped_frames_ = 0;
+    }
+    has_flip_time_ = false;
+    crtc_configured_ = false;
+    flip_pending_ = false;
+    flip_failures_ = 0;
+    modeset_failing_ = false;
 }
 
 /// @brief バックバッファとフロントバッファを交換し、描画内容を画面に表示する
 /// @note この関数は、EGLとGBMを使用して描画内容を画面に表示します。
-///       DRM/KMSを使用して、フレームバッファをディスプレイに設定します。
+///       SetCrtcモードでは毎フレームdrmModeSetCrtc()でモードセットします。
+///       PageFlipモードでは最初のフレームだけモードセットし、以降はdrmModePageFlip()で
+///       垂直同期に合わせた切り替えをキューして即座に戻ります。前フレームのフリップが
+///       未完了の場合のみ、その完了イベントを待ちます。これにより、フレームNの表示中に
+///       フレームN+1の描画を進められます。
 ///       事前にinitialize()を呼び出して、必要なリソースを確保しておく必要があります。
 ///       また、描画内容はOpenGL ESで行われている前提です
 void GraphicsPlatform::swapBuffers()
 {
-    eglSwapBuffers(display_, surface_);
+    if (backend_ == Backend::Headless)
+    {
+        presentHeadless();
+        return;
+    }
+    {
+        TRACE_SCOPE("eglSwapBuffers");
+        eglSwapBuffers(display_, surface_);
+    }
     struct gbm_bo *next_bo = gbm_surface_lock_front_buffer(gbm_surface_);
     if (!next_bo)
     {
@@ -282,25 +583,276 @@ void GraphicsPlatform::swapBuffers()
         return;
     }
 
-    uint32_t handle = gbm_bo_get_handle(next_bo).u32;
-    uint32_t pitch = gbm_bo_get_stride(next_bo);
-    uint32_t fb_id = 0;
-    if (drmModeAddFB(drm_fd_, mode_info_.hdisplay, mode_info_.vdisplay, 24, 32, pitch, handle, &fb_id) != 0)
+    uint32_t fb_id = getFramebufferId(next_bo);
+    if (fb_id == 0)
     {
-        std::cerr << "Failed to add DRM framebuffer." << std::endl;
         gbm_surface_release_buffer(gbm_surface_, next_bo);
         return;
     }
 
-    drmModeSetCrtc(drm_fd_, crtc_id_, fb_id, 0, 0, &connector_id_, 1, &mode_info_);
+    if (present_mode_ == PresentMode::PageFlip && crtc_configured_)
+    {
+        // 同時にキューできるフリップは1つだけなので、前のフリップの完了を待つ
+        // （完了イベントが届かなかった場合は crtc_configured_ が戻り、このフレームはモードセットで表示する）
+        waitForPendingFlip();
+
+        // 完了イベントと照合できるよう、user_data にはフリップ毎の通し番号を渡す
+        const uint32_t sequence = flip_sequence_ + 1;
+        void *cookie = reinterpret_cast<void *>(static_cast<uintptr_t>(sequence));
+        const int ret = crtc_configured_ ? drmModePageFlip(drm_fd_, crtc_id_, fb_id, DRM_MODE_PAGE_FLIP_EVENT, cookie) : 0;
+        if (crtc_configured_ && ret == 0)
+        {
+            flip_sequence_ = sequence;
+            pending_bo_ = next_bo;
+            flip_pending_ = true;
+            flip_failures_ = 0;
+            TRACE_INSTANT("flip_queued", "fb_id", fb_id);
+            return;
+        }
+        if (crtc_configured_)
+        {
+            // 一時的な失敗(EBUSYなど)ではこのフレームだけモードセットで表示し、次のフレームで再びフリップを試す。
+            // 失敗が続く場合のみ、ページフリップが使えないものとして SetCrtc に切り替える
+            if (++flip_failures_ >= kMaxFlipFailures)
+            {
+                std::cerr << "[GraphicsPlatform] drmModePageFlip failed " << flip_failures_
+                          << " times in a row. Falling back to set crtc mode." << std::endl;
+                present_mode_ = PresentMode::SetCrtc;
+            }
+            else if (flip_failures_ == 1)
+            {
+                std::cerr << "[GraphicsPlatform] drmModePageFlip failed: " << std::strerror(-ret)
+                          << ". Using set crtc for this frame." << std::endl;
+            }
+        }
+    }
+
+    const int modeset = drmModeSetCrtc(drm_fd_, crtc_id_, fb_id, 0, 0, &connector_id_, 1, &mode_info_);
+    if (modeset != 0)
+    {
+        // 表示先が変わっていないので、表示中かもしれない古いバッファは返却せず、このフレームのバッファだけ返す。
+        // crtc_configured_ は戻したままにして、次のフレームでもモードセットをやり直す
+        if (!modeset_failing_)
+        {
+            std::cerr << "[GraphicsPlatform] drmModeSetCrtc failed: " << std::strerror(-modeset) << std::endl;
+            modeset_failing_ = true;
+        }
+        crtc_configured_ = false;
+        gbm_surface_release_buffer(gbm_surface_, next_bo);
+        return;
+    }
+    modeset_failing_ = false;
+    crtc_configured_ = true;
 
     if (previous_bo_)
     {
-        drmModeRmFB(drm_fd_, previous_fb_id_);
         gbm_surface_release_buffer(gbm_surface_, previous_bo_);
     }
+    if (stale_bo_)
+    {
+        // モードセットで表示先が next_bo に確定したので、完了を確認できなかったフリップのバッファも返却できる
+        gbm_surface_release_buffer(gbm_surface_, stale_bo_);
+        stale_bo_ = nullptr;
+    }
     previous_bo_ = next_bo;
-    previous_fb_id_ = fb_id;
+}
+
+/// @brief GBMバッファ毎にキャッシュしたDRMフレームバッファのID
+struct DrmFramebuffer
+{
+    int drm_fd;
+    uint32_t fb_id;
+};
+
+/// @brief GBMバッファに対応するDRMフレームバッファIDを取得する
+/// @note GBMサーフェスは同じ2〜3枚のバッファを使い回すため、初回だけdrmModeAddFB()を呼び、
+///       IDはバッファのユーザーデータとして保持して再利用します。
+///       IDはバッファ破棄時にdestroyFramebufferUserData()で削除されます。
+/// @param bo GBMバッファ
+/// @return フレームバッファID。失敗した場合は0
+uint32_t GraphicsPlatform::getFramebufferId(struct gbm_bo *bo)
+{
+    DrmFramebuffer *fb = static_cast<DrmFramebuffer *>(gbm_bo_get_user_data(bo));
+    if (fb)
+    {
+        fb_stats_.addCallsAvoided++;
+        return fb->fb_id;
+    }
+
+    uint32_t handle = gbm_bo_get_handle(bo).u32;
+    uint32_t pitch = gbm_bo_get_stride(bo);
+    uint32_t fb_id = 0;
+    if (drmModeAddFB(drm_fd_, gbm_bo_get_width(bo), gbm_bo_get_height(bo), 24, 32, pitch, handle, &fb_id) != 0)
+    {
+        std::cerr << "Failed to add DRM framebuffer." << std::endl;
+        return 0;
+    }
+    fb_stats_.addCalls++;
+
+    gbm_bo_set_user_data(bo, new DrmFramebuffer{drm_fd_, fb_id}, &GraphicsPlatform::destroyFramebufferUserData);
+    return fb_id;
+}
+
+/// @brief GBMバッファ破棄時に、紐付けたDRMフレームバッファを削除する
+void GraphicsPlatform::destroyFramebufferUserData(struct gbm_bo * /*bo*/, void *data)
+{
+    DrmFramebuffer *fb = static_cast<DrmFramebuffer *>(data);
+    if (fb->fb_id != 0)
+    {
+        drmModeRmFB(fb->drm_fd, fb->fb_id);
+    }
+    delete fb;
+}
+
+GraphicsPlatform::FramebufferStats GraphicsPlatform::getFramebufferStats() const
+{
+    return fb_stats_;
+}
+
+GraphicsPlatform::FlipStats GraphicsPlatform::getFlipStats() const
+{
+    return flip_stats_;
+}
+
+/// @brief 表示モードからリフレッシュ間隔を求める
+/// @note vrefreshは整数に丸められている（59.94Hzが60になる）ので、ピクセルクロックと総画素数から正確に求めます。
+void GraphicsPlatform::updateRefreshInterval()
+{
+    const uint64_t totalPixels = static_cast<uint64_t>(mode_info_.htotal) * mode_info_.vtotal;
+    if (mode_info_.clock > 0 && totalPixels > 0)
+    {
+        // clockはkHz単位
+        refresh_interval_ = std::chrono::nanoseconds(totalPixels * 1000000 / mode_info_.clock);
+    }
+    else if (mode_info_.vrefresh > 0)
+    {
+        refresh_interval_ = std::chrono::nanoseconds(1000000000 / mode_info_.vrefresh);
+    }
+    std::cout << "[GraphicsPlatform] Refresh interval " << refresh_interval_.count() / 1000 << " us." << std::endl;
+}
+
+std::chrono::nanoseconds GraphicsPlatform::getRefreshInterval() const
+{
+    return refresh_interval_;
+}
+
+/// @brief これから描画するフレームが画面に表示される時刻を予測する
+/// @note 直近のフリップ時刻から数えて、現在時刻の次の垂直同期を求めます。前のフリップが未完了なら
+///       それがその垂直同期を使うので、今回のフレームはさらに1フレーム後に表示されます。
+std::chrono::steady_clock::time_point GraphicsPlatform::predictPresentTime() const
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (present_mode_ != PresentMode::PageFlip || !has_flip_time_)
+        return now;
+
+    const auto sinceFlip = now - last_flip_time_;
+    const int64_t elapsedVblanks = sinceFlip.count() > 0 ? sinceFlip / refresh_interval_ : 0;
+    const int64_t vblanks = elapsedVblanks + 1 + (flip_pending_ ? 1 : 0);
+    return last_flip_time_ + refresh_interval_ * vblanks;
+}
+
+/// @brief キュー済みのページフリップが完了するまで待つ
+/// @note DRMデバイスのfdをpollし、drmHandleEvent()でフリップ完了イベントを処理します。
+///       フリップが完了すると、それまで表示していたバッファが解放されます。
+///       イベントが届かないまま待ちきれなかった場合は、どちらのバッファが表示中か分からないので、
+///       フリップ待ちのバッファを保留にしたまま待ち状態を解除し、次のフレームをモードセットで表示し直します。
+void GraphicsPlatform::waitForPendingFlip()
+{
+    TRACE_SCOPE("wait_for_flip");
+    drmEventContext ev_context = {};
+    ev_context.version = DRM_EVENT_CONTEXT_VERSION;
+    ev_context.page_flip_handler = &GraphicsPlatform::onPageFlipComplete;
+
+    while (flip_pending_)
+    {
+        struct pollfd pfd = {drm_fd_, POLLIN, 0};
+        int ret = poll(&pfd, 1, 1000); // 1秒以上イベントが来なければ異常とみなす
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "[GraphicsPlatform] poll on DRM fd failed." << std::endl;
+            abandonPendingFlip();
+            break;
+        }
+        if (ret == 0)
+        {
+            std::cerr << "[GraphicsPlatform] Timeout waiting for page flip event." << std::endl;
+            abandonPendingFlip();
+            break;
+        }
+        event_target_ = this;
+        drmHandleEvent(drm_fd_, &ev_context);
+        event_target_ = nullptr;
+    }
+}
+
+/// @brief 完了イベントが届かなかったフリップの待ち状態を解除する
+void GraphicsPlatform::abandonPendingFlip()
+{
+    if (stale_bo_)
+    {
+        gbm_surface_release_buffer(gbm_surface_, stale_bo_);
+    }
+    stale_bo_ = pending_bo_;
+    pending_bo_ = nullptr;
+    flip_pending_ = false;
+    crtc_configured_ = false;
+}
+
+/// @brief 表示された時刻を記録する
+/// @note 前の表示から2フレーム以上空いていれば、その間の垂直同期に間に合わなかったものとして数えます。
+void GraphicsPlatform::recordFlip(std::chrono::steady_clock::time_point flipTime)
+{
+    flip_stats_.flips++;
+    if (has_flip_time_)
+    {
+        const int64_t interval = refresh_interval_.count();
+        const int64_t sinceLast = std::chrono::duration_cast<std::chrono::nanoseconds>(flipTime - last_flip_time_).count();
+        const int64_t vblanks = (sinceLast + interval / 2) / interval;
+        if (vblanks > 1)
+            flip_stats_.missedVblanks += static_cast<uint64_t>(vblanks - 1);
+    }
+    last_flip_time_ = flipTime;
+    has_flip_time_ = true;
+}
+
+/// @brief ページフリップ完了ハンドラ
+/// @note 新しいバッファが表示されたので、それまで表示していたバッファをGBMに返却します。
+void GraphicsPlatform::onPageFlipComplete(int /*fd*/, unsigned int /*sequence*/, unsigned int tv_sec,
+                                          unsigned int tv_usec, void *user_data)
+{
+    GraphicsPlatform *self = event_target_;
+    const uint32_t sequence = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(user_data));
+    if (!self || !self->flip_pending_ || sequence != self->flip_sequence_)
+    {
+        // 待ちきれずに解除したフリップのイベントが遅れて届いたもの。今待っているフリップの完了ではないので、
+        // 表示中のバッファを返却しないよう無視する（そのフリップのバッファはモードセット時に返却済み）
+        return;
+    }
+    if (self->monotonic_timestamps_)
+    {
+        // タイムスタンプはフリップが実際に行われた垂直同期の時刻
+        self->recordFlip(std::chrono::steady_clock::time_point(std::chrono::seconds(tv_sec) +
+                                                               std::chrono::microseconds(tv_usec)));
+        // イベントが届くまでの遅れ（垂直同期からの経過時間）
+        TRACE_INSTANT("page_flip", "vblank_lag_us",
+                      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                                            self->last_flip_time_)
+                          .count());
+    }
+    else
+    {
+        self->flip_stats_.flips++;
+        TRACE_INSTANT("page_flip", nullptr, 0);
+    }
+    if (self->previous_bo_)
+    {
+        gbm_surface_release_buffer(self->gbm_surface_, self->previous_bo_);
+    }
+    self->previous_bo_ = self->pending_bo_;
+    self->pending_bo_ = nullptr;
+    self->flip_pending_ = false;
 }
 
 /// @brief フレームバッファをPNG形式で保存する
@@ -358,13 +910,17 @@ void GraphicsPlatform::saveFramebufferToPNG(const char *filename)
 
 /// @brief ピクセルデータをPNG形式で保存する
 /// @param filename 保存するファイル名
-/// @param data ピクセルデータ（RGBA形式）
+/// @param data ピクセルデータ（RGBA形式、画面と同じ大きさ）
 /// @return
 bool GraphicsPlatform::savePixelsToPNG(const char *filename, const unsigned char *data)
 {
-    int width = mode_info_.hdisplay;
-    int height = mode_info_.vdisplay;
+    return savePixelsToPNG(filename, data, mode_info_.hdisplay, mode_info_.vdisplay);
+}
 
+/// @brief 大きさを指定してピクセルデータをPNG形式で保存する
+/// @note 画面に依存しないので、GraphicsPlatformを初期化せずに使える（ベンチマークなど）
+bool GraphicsPlatform::savePixelsToPNG(const char *filename, const unsigned char *data, int width, int height)
+{
     FILE *fp = fopen(filename, "wb");
     if (!fp)
     {
@@ -0,0 +1,351 @@
+#include "MetricsServer.h"
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <locale>
+#include <sstream>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+    // ヒストグラムとして公開するバケットの上限（秒）。60Hzと30Hzの1フレーム付近を細かく刻む
+    constexpr double kBucketBounds[] = {0.001, 0.002, 0.004, 0.008, 0.012, 0.016, 0.020, 0.025, 0.033, 0.050, 0.100, 0.250};
+
+    // 応答を返し終えるまで1クライアントに掛ける時間の上限
+    constexpr int kClientTimeoutSec = 2;
+
+    long readResidentBytes()
+    {
+        FILE *statm = std::fopen("/proc/self/statm", "r");
+        if (!statm)
+            return -1;
+        long sizePages = 0;
+        long residentPages = 0;
+        const int fields = std::fscanf(statm, "%ld %ld", &sizePages, &residentPages);
+        std::fclose(statm);
+        return fields == 2 ? residentPages * sysconf(_SC_PAGESIZE) : -1;
+    }
+
+    void writeHeader(std::ostringstream &out, const char *name, const char *type, const char *help)
+    {
+        out << "# HELP " << name << ' ' << help << '\n' << "# TYPE " << name << ' ' << type << '\n';
+    }
+
+    template <typename T>
+    void writeValue(std::ostringstream &out, const char *name, const char *type, const char *help, T value)
+    {
+        writeHeader(out, name, type, help);
+        out << name << ' ' << value << '\n';
+    }
+
+    // ヒストグラムの累積バケットを書く。件数を正確に保つため、公開するバケットの上限は
+    // kBucketBounds の値を含む内部バケットの上端に合わせる（例: 16ms は 16.384ms になる）
+    void writeHistogram(std::ostringstream &out, const char *name, const char *stage,
+                        const LatencyHistogram::Snapshot &snapshot)
+    {
+        int bucket = 0;
+        uint64_t cumulative = 0;
+        for (double bound : kBucketBounds)
+        {
+            const uint64_t boundMicros = static_cast<uint64_t>(bound * 1e6 + 0.5);
+            while (bucket < LatencyHistogram::kBucketCount && LatencyHistogram::bucketUpperBound(bucket) < boundMicros)
+                cumulative += snapshot.counts[bucket++];
+            if (bucket < LatencyHistogram::kBucketCount)
+                cumulative += snapshot.counts[bucket++];
+            // 記録はus未満を切り捨てているので、上限のバケットに入る値は (上端 + 1us) 未満
+            const double edge = (LatencyHistogram::bucketUpperBound(bucket - 1) + 1) / 1e6;
+            out << name << "_bucket{stage=\"" << stage << "\",le=\"" << edge << "\"} " << cumulative << '\n';
+        }
+        out << name << "_bucket{stage=\"" << stage << "\",le=\"+Inf\"} " << snapshot.total << '\n';
+        out << name << "_sum{stage=\"" << stage << "\"} " << snapshot.sumMicros / 1e6 << '\n';
+        out << name << "_count{stage=\"" << stage << "\"} " << snapshot.total << '\n';
+    }
+}
+
+MetricsServer::MetricsServer(FrameProfiler &profiler) : profiler_(profiler), startTime_(std::chrono::steady_clock::now())
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+    stop();
+}
+
+bool MetricsServer::startSocket(const std::string &path)
+{
+    stop();
+
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "[Metrics] Invalid socket path: " << path << std::endl;
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size());
+
+    listenFd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd_ < 0)
+    {
+        std::cerr << "[Metrics] Failed to create socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    unlink(path.c_str());
+    if (bind(listenFd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || listen(listenFd_, 4) < 0)
+    {
+        std::cerr << "[Metrics] Failed to listen on " << path << ": " << std::strerror(errno) << std::endl;
+        stop();
+        return false;
+    }
+
+    socketPath_ = path;
+    if (!startWorker())
+        return false;
+    std::cout << "[Metrics] Serving on " << path << std::endl;
+    return true;
+}
+
+bool MetricsServer::startTcp(int port)
+{
+    stop();
+
+    if (port <= 0 || port > 65535)
+    {
+        std::cerr << "[Metrics] Invalid port: " << port << std::endl;
+        return false;
+    }
+    listenFd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd_ < 0)
+    {
+        std::cerr << "[Metrics] Failed to create socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    const int reuse = 1;
+    setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    // 外部には公開せず、同じ機器のエージェントからだけ読めるようにする
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listenFd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || listen(listenFd_, 4) < 0)
+    {
+        std::cerr << "[Metrics] Failed to listen on 127.0.0.1:" << port << ": " << std::strerror(errno) << std::endl;
+        stop();
+        return false;
+    }
+
+    if (!startWorker())
+        return false;
+    std::cout << "[Metrics] Serving on http://127.0.0.1:" << port << "/metrics" << std::endl;
+    return true;
+}
+
+bool MetricsServer::startWorker()
+{
+    wakeFd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wakeFd_ < 0)
+    {
+        std::cerr << "[Metrics] Failed to create eventfd: " << std::strerror(errno) << std::endl;
+        stop();
+        return false;
+    }
+    stopping_.store(false, std::memory_order_relaxed);
+    thread_ = std::thread(&MetricsServer::serveLoop, this);
+    return true;
+}
+
+void MetricsServer::stop()
+{
+    stopping_.store(true, std::memory_order_relaxed);
+    if (thread_.joinable())
+    {
+        const uint64_t one = 1;
+        if (write(wakeFd_, &one, sizeof(one)) < 0)
+            std::cerr << "[Metrics] Failed to wake the metrics thread: " << std::strerror(errno) << std::endl;
+        thread_.join();
+    }
+
+    if (listenFd_ >= 0)
+    {
+        close(listenFd_);
+        listenFd_ = -1;
+    }
+    if (!socketPath_.empty())
+    {
+        unlink(socketPath_.c_str());
+        socketPath_.clear();
+    }
+    if (wakeFd_ >= 0)
+    {
+        close(wakeFd_);
+        wakeFd_ = -1;
+    }
+}
+
+bool MetricsServer::isRunning() const
+{
+    return thread_.joinable();
+}
+
+void MetricsServer::serveLoop()
+{
+    while (!stopping_.load(std::memory_order_relaxed))
+    {
+        pollfd fds[2];
+        fds[0].fd = wakeFd_;
+        fds[0].events = POLLIN;
+        fds[1].fd = listenFd_;
+        fds[1].events = POLLIN;
+        if (::poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "[Metrics] poll() failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        if (fds[0].revents)
+            break;
+        if (!fds[1].revents)
+            continue;
+
+        const int clientFd = accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (clientFd < 0)
+        {
+            if (errno != EINTR && errno != EAGAIN)
+                std::cerr << "[Metrics] accept() failed: " << std::strerror(errno) << std::endl;
+            continue;
+        }
+        handleClient(clientFd);
+        close(clientFd);
+    }
+}
+
+void MetricsServer::handleClient(int clientFd)
+{
+    // 応答の途中で止まったクライアントに、このスレッドをいつまでも占有されないようにする
+    const timeval timeout = {kClientTimeoutSec, 0};
+    setsockopt(clientFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(clientFd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // リクエストヘッダの終わりまで読む（本文は使わない）
+    std::string request;
+    char chunk[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192)
+    {
+        const ssize_t received = read(clientFd, chunk, sizeof(chunk));
+        if (received <= 0)
+        {
+            if (received < 0 && errno == EINTR)
+                continue;
+            break;
+        }
+        request.append(chunk, static_cast<size_t>(received));
+    }
+
+    std::string body;
+    const char *status = "200 OK";
+    if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 6, "GET / ") == 0)
+    {
+        formatMetrics(body);
+    }
+    else
+    {
+        status = "404 Not Found";
+        body = "Only GET /metrics is served.\n";
+    }
+
+    std::ostringstream response;
+    response << "HTTP/1.1 " << status << "\r\n"
+             << "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+             << "Content-Length: " << body.size() << "\r\n"
+             << "Connection: close\r\n\r\n"
+             << body;
+    const std::string data = response.str();
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        const ssize_t written = send(clientFd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (written <= 0)
+        {
+            if (written < 0 && errno == EINTR)
+                continue;
+            break;
+        }
+        sent += static_cast<size_t>(written);
+    }
+}
+
+void MetricsServer::formatMetrics(std::string &out)
+{
+    // 描画スレッドが最後に公開した統計（まだ公開されていなければ初期値）
+    stats_.consume();
+    const RenderStats &stats = stats_.front();
+
+    std::ostringstream metrics;
+    // 数値は桁区切りなどの無い形式で、積算時間も丸めずに書く
+    metrics.imbue(std::locale::classic());
+    metrics << std::setprecision(12);
+    writeValue(metrics, "raspi_gl_uptime_seconds", "gauge", "Seconds since the player started.",
+               std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime_).count());
+    writeValue(metrics, "raspi_gl_resident_memory_bytes", "gauge", "Resident set size of the process.",
+               readResidentBytes());
+    writeValue(metrics, "raspi_gl_fps", "gauge", "Frames rendered in the last second.", stats.fps);
+
+    // 段階毎の処理時間は累積のヒストグラムをそのまま公開する（区間の分布は Prometheus 側の rate() で求める）
+    LatencyHistogram::Snapshot snapshot;
+    profiler_.getCpuHistogram(FrameProfiler::Stage::Frame).snapshot(snapshot);
+    writeValue(metrics, "raspi_gl_frames_total", "counter", "Frames rendered.", snapshot.total);
+
+    writeHeader(metrics, "raspi_gl_stage_seconds", "histogram", "CPU time of each render loop stage.");
+    for (int stage = 0; stage < static_cast<int>(FrameProfiler::Stage::Count); ++stage)
+    {
+        const FrameProfiler::Stage id = static_cast<FrameProfiler::Stage>(stage);
+        profiler_.getCpuHistogram(id).snapshot(snapshot);
+        writeHistogram(metrics, "raspi_gl_stage_seconds", FrameProfiler::getStageName(id), snapshot);
+    }
+    writeHeader(metrics, "raspi_gl_stage_gpu_seconds", "histogram",
+                "GPU time of each render loop stage (only with RASPI_GL_GPU_TIMERS=1).");
+    for (int stage = 0; stage < static_cast<int>(FrameProfiler::Stage::Count); ++stage)
+    {
+        const FrameProfiler::Stage id = static_cast<FrameProfiler::Stage>(stage);
+        profiler_.getGpuHistogram(id).snapshot(snapshot);
+        if (snapshot.total > 0)
+            writeHistogram(metrics, "raspi_gl_stage_gpu_seconds", FrameProfiler::getStageName(id), snapshot);
+    }
+
+    writeValue(metrics, "raspi_gl_video_frames_received_total", "counter", "Frames received from the appsink.",
+               stats.frameQueue.received);
+    writeValue(metrics, "raspi_gl_video_frames_dropped_total", "counter",
+               "Frames dropped because the frame queue was full.", stats.frameQueue.dropped);
+    writeValue(metrics, "raspi_gl_video_frames_skipped_total", "counter",
+               "Frames skipped by the latest-frame queue policy.", stats.frameQueue.skipped);
+    writeValue(metrics, "raspi_gl_frame_queue_depth", "gauge", "Frames waiting in the appsink queue.",
+               stats.frameQueue.depth);
+    writeValue(metrics, "raspi_gl_page_flips_total", "counter", "Completed page flips.", stats.flips.flips);
+    writeValue(metrics, "raspi_gl_late_frames_total", "counter", "Vblanks missed between consecutive page flips.",
+               stats.flips.missedVblanks);
+    writeValue(metrics, "raspi_gl_texture_ring_exhausted_total", "counter",
+               "Uploads that waited for the GPU because no video texture set was free.", stats.textureRing.exhausted);
+
+    writeValue(metrics, "raspi_gl_glyph_cache_hits_total", "counter", "Glyph cache hits.", stats.glyphCache.hits);
+    writeValue(metrics, "raspi_gl_glyph_cache_misses_total", "counter", "Glyph cache misses.", stats.glyphCache.misses);
+    writeValue(metrics, "raspi_gl_glyph_cache_evictions_total", "counter", "Glyphs evicted from the cache.",
+               stats.glyphCache.evictions);
+    writeValue(metrics, "raspi_gl_glyph_cache_glyphs", "gauge", "Glyphs in the cache.", stats.glyphCache.glyphs);
+
+    writeHeader(metrics, "raspi_gl_texture_bytes", "gauge", "GPU memory allocated for textures.");
+    metrics << "raspi_gl_texture_bytes{kind=\"video\"} " << stats.videoTextureBytes << '\n';
+    metrics << "raspi_gl_texture_bytes{kind=\"glyph\"} " << stats.glyphTextureBytes << '\n';
+
+    out = metrics.str();
+}
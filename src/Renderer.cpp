@@ -1,15 +1,19 @@
 #include "Renderer.h"
 #include "ShaderUtils.h"
+#include "GLStateCache.h"
 #include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
 #include <EGL/egl.h>
 #include <iostream>
 #include <vector>
 #include <cstring>
+#include <chrono>
+#include <algorithm>
 
 Renderer::Renderer()
     : fbo_(0), fboTexture_(0), fullScreenQuadVBO_(0),
       fboRenderProgram_(0), fboRenderTextureLoc_(-1),
-      yuvProgram_(0), yTex_(0), uTex_(0), vTex_(0),
+      yuvProgram_(0),
       fboWidth_(0), fboHeight_(0)
 {
 }
@@ -19,8 +23,9 @@ Renderer::~Renderer()
     shutdown();
 }
 
-bool Renderer::initialize(int width, int height)
+bool Renderer::initialize(int width, int height, GLStateCache &glState)
 {
+    glState_ = &glState;
     fboWidth_ = width;
     fboHeight_ = height;
 
@@ -83,22 +88,43 @@ bool Renderer::initialize(int width, int height)
         return false;
     }
     fboRenderTextureLoc_ = glGetUniformLocation(fboRenderProgram_, "uTexture");
-    GLint posLoc = glGetAttribLocation(fboRenderProgram_, "aPos");
-    if (posLoc < 0)
+    fboRenderPositionLoc_ = glGetAttribLocation(fboRenderProgram_, "aPos");
+    if (fboRenderPositionLoc_ < 0)
     {
         std::cerr << "Failed to get attribute location for aPos." << std::endl;
         shutdown();
         return false;
     }
-    glUseProgram(fboRenderProgram_);
-    glBindBuffer(GL_ARRAY_BUFFER, fullScreenQuadVBO_);
-    glEnableVertexAttribArray(posLoc);
-    glVertexAttribPointer(posLoc, 2, GL_FLOAT, GL_FALSE, 0, 0);
 
-    // YUV用テクスチャとシェーダの初期化
-    glGenTextures(1, &yTex_);
-    glGenTextures(1, &uTex_);
-    glGenTextures(1, &vTex_);
+    // パディング付きの行をCPUで詰め直さずにアップロードできるか
+    const char *extensions = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+    hasUnpackSubimage_ = extensions && std::strstr(extensions, "GL_EXT_unpack_subimage") != nullptr;
+    std::cout << "[Renderer] GL_EXT_unpack_subimage: " << (hasUnpackSubimage_ ? "yes" : "no") << std::endl;
+
+    // 映像テクスチャセットのリングを用意する
+    textureSets_.assign(textureRingSize_, VideoTextureSet());
+    for (VideoTextureSet &set : textureSets_)
+    {
+        glGenTextures(1, &set.y.id);
+        glGenTextures(1, &set.u.id);
+        glGenTextures(1, &set.v.id);
+        glGenTextures(1, &set.uv.id);
+    }
+    currentSet_ = 0;
+
+    // GPUがテクスチャセットを使い終えたかを知るためのフェンス (EGL_KHR_fence_sync)
+    eglDisplay_ = eglGetCurrentDisplay();
+    const char *eglExtensions = eglDisplay_ != EGL_NO_DISPLAY ? eglQueryString(eglDisplay_, EGL_EXTENSIONS) : nullptr;
+    if (eglExtensions && std::strstr(eglExtensions, "EGL_KHR_fence_sync"))
+    {
+        eglCreateSyncKHR_ = reinterpret_cast<PFNEGLCREATESYNCKHRPROC>(eglGetProcAddress("eglCreateSyncKHR"));
+        eglDestroySyncKHR_ = reinterpret_cast<PFNEGLDESTROYSYNCKHRPROC>(eglGetProcAddress("eglDestroySyncKHR"));
+        eglClientWaitSyncKHR_ = reinterpret_cast<PFNEGLCLIENTWAITSYNCKHRPROC>(eglGetProcAddress("eglClientWaitSyncKHR"));
+    }
+    std::cout << "[Renderer] Video texture ring: " << textureRingSize_ << " sets, EGL_KHR_fence_sync: "
+              << (eglCreateSyncKHR_ ? "yes" : "no") << std::endl;
+
+    // YUV用シェーダの初期化
 
     const char *yuvVs = vs; // 同じ頂点シェーダを使う
     const char *yuvFs = R"(
@@ -107,10 +133,12 @@ bool Renderer::initialize(int width, int height)
         uniform sampler2D texY;
         uniform sampler2D texU;
         uniform sampler2D texV;
+        uniform vec2 texScaleY;
+        uniform vec2 texScaleC;
         void main() {
-            float y = texture2D(texY, vTexCoord).r;
-            float u = texture2D(texU, vTexCoord).r - 0.5;
-            float v = texture2D(texV, vTexCoord).r - 0.5;
+            float y = texture2D(texY, vTexCoord * texScaleY).r;
+            float u = texture2D(texU, vTexCoord * texScaleC).r - 0.5;
+            float v = texture2D(texV, vTexCoord * texScaleC).r - 0.5;
             float r = y + 1.402 * v;
             float g = y - 0.344 * u - 0.714 * v;
             float b = y + 1.772 * u;
@@ -125,12 +153,42 @@ bool Renderer::initialize(int width, int height)
         shutdown();
         return false;
     }
+    yuvLocs_.texY = glGetUniformLocation(yuvProgram_, "texY");
+    yuvLocs_.texC0 = glGetUniformLocation(yuvProgram_, "texU");
+    yuvLocs_.texC1 = glGetUniformLocation(yuvProgram_, "texV");
+    yuvLocs_.texScaleY = glGetUniformLocation(yuvProgram_, "texScaleY");
+    yuvLocs_.texScaleC = glGetUniformLocation(yuvProgram_, "texScaleC");
+    yuvLocs_.position = glGetAttribLocation(yuvProgram_, "aPos");
+
+    // NV12用シェーダの初期化（Y + UVインターリーブ）
+    const std::string nv12VertPath = getShaderPath("nv12.vert");
+    const std::string nv12FragPath = getShaderPath("nv12.frag");
+    nv12Program_ = createProgramFromFiles(nv12VertPath.c_str(), nv12FragPath.c_str());
+    if (!nv12Program_)
+    {
+        std::cerr << "Failed to create NV12 shader program from " << nv12VertPath << " and " << nv12FragPath << std::endl;
+        shutdown();
+        return false;
+    }
+    nv12Locs_.texY = glGetUniformLocation(nv12Program_, "texY");
+    nv12Locs_.texC0 = glGetUniformLocation(nv12Program_, "texUV");
+    nv12Locs_.texScaleY = glGetUniformLocation(nv12Program_, "texScaleY");
+    nv12Locs_.texScaleC = glGetUniformLocation(nv12Program_, "texScaleUV");
+    nv12Locs_.position = glGetAttribLocation(nv12Program_, "a_position");
 
+    // 初期化中はキャッシュを経由せずにGLを操作したので、記録を捨てる
+    glState_->invalidate();
     return true;
 }
 
 void Renderer::shutdown()
 {
+    if (glState_)
+    {
+        glState_->forgetProgram(fboRenderProgram_);
+        glState_->forgetProgram(yuvProgram_);
+        glState_->forgetProgram(nv12Program_);
+    }
     if (fboTexture_)
     {
         glDeleteTextures(1, &fboTexture_);
@@ -156,20 +214,142 @@ void Renderer::shutdown()
         glDeleteProgram(yuvProgram_);
         yuvProgram_ = 0;
     }
-    if (yTex_)
+    for (VideoTextureSet &set : textureSets_)
     {
-        glDeleteTextures(1, &yTex_);
-        yTex_ = 0;
+        destroyFence(set);
+        deletePlaneTexture(set.y);
+        deletePlaneTexture(set.u);
+        deletePlaneTexture(set.v);
+        deletePlaneTexture(set.uv);
     }
-    if (uTex_)
+    textureSets_.clear();
+    if (nv12Program_)
     {
-        glDeleteTextures(1, &uTex_);
-        uTex_ = 0;
+        glDeleteProgram(nv12Program_);
+        nv12Program_ = 0;
     }
-    if (vTex_)
+}
+
+void Renderer::deletePlaneTexture(PlaneTexture &texture)
+{
+    if (texture.id)
     {
-        glDeleteTextures(1, &vTex_);
-        vTex_ = 0;
+        if (glState_)
+            glState_->forgetTexture(texture.id);
+        glDeleteTextures(1, &texture.id);
+    }
+    texture = PlaneTexture();
+}
+
+void Renderer::setTextureRingSize(int count)
+{
+    textureRingSize_ = std::max(1, count);
+}
+
+Renderer::TextureRingStats Renderer::getTextureRingStats() const
+{
+    return ringStats_;
+}
+
+size_t Renderer::getTextureBytes() const
+{
+    auto planeBytes = [](const PlaneTexture &texture) -> size_t {
+        const size_t bytesPerPixel = texture.format == GL_LUMINANCE_ALPHA ? 2 : 1;
+        return texture.format == 0 ? 0 : static_cast<size_t>(texture.width) * texture.height * bytesPerPixel;
+    };
+    size_t bytes = fboTexture_ ? static_cast<size_t>(fboWidth_) * fboHeight_ * 4 : 0;
+    for (const VideoTextureSet &set : textureSets_)
+        bytes += planeBytes(set.y) + planeBytes(set.u) + planeBytes(set.v) + planeBytes(set.uv);
+    return bytes;
+}
+
+void Renderer::destroyFence(VideoTextureSet &set)
+{
+    if (set.fence != EGL_NO_SYNC_KHR)
+    {
+        eglDestroySyncKHR_(eglDisplay_, set.fence);
+        set.fence = EGL_NO_SYNC_KHR;
+    }
+}
+
+/// @brief テクスチャセットをGPUが使い終えているかを、待たずに調べる
+bool Renderer::isTextureSetIdle(VideoTextureSet &set)
+{
+    if (set.fence == EGL_NO_SYNC_KHR)
+        return true;
+    if (eglClientWaitSyncKHR_(eglDisplay_, set.fence, 0, 0) != EGL_CONDITION_SATISFIED_KHR)
+        return false;
+    destroyFence(set);
+    return true;
+}
+
+/// @brief 次のフレームをアップロードするテクスチャセットを選ぶ
+/// @note 描画中のセット（currentSet_）は避け、フェンスが通過済みのセットを探す。
+///       全て使用中の場合は、最も古いセットのフェンスを待ってから使う（統計に記録する）。
+Renderer::VideoTextureSet &Renderer::acquireTextureSet()
+{
+    const int count = static_cast<int>(textureSets_.size());
+    if (count > 1)
+    {
+        for (int i = 1; i < count; ++i)
+        {
+            int index = (currentSet_ + i) % count;
+            if (isTextureSetIdle(textureSets_[index]))
+            {
+                currentSet_ = index;
+                return textureSets_[currentSet_];
+            }
+        }
+
+        currentSet_ = (currentSet_ + 1) % count;
+        VideoTextureSet &oldest = textureSets_[currentSet_];
+        ringStats_.exhausted++;
+        auto start = std::chrono::steady_clock::now();
+        eglClientWaitSyncKHR_(eglDisplay_, oldest.fence, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
+        ringStats_.waitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        destroyFence(oldest);
+    }
+    return textureSets_[currentSet_];
+}
+
+void Renderer::setCompositionMode(CompositionMode mode)
+{
+    compositionMode_ = mode;
+}
+
+Renderer::CompositionMode Renderer::getCompositionMode() const
+{
+    return compositionMode_;
+}
+
+/// @brief 1フレーム分の合成を開始する
+/// @note Directモードでは通常はバックバッファへ直接描画し、FBOからの全画面コピーを省く。
+///       スクリーンショットなど、後でreadPixelsFromFBO()で読み出すフレームだけFBOへ描画する。
+/// @param needCapture このフレームをreadPixelsFromFBO()で読み出すか
+/// @return FBOへ描画する場合はtrue
+bool Renderer::beginFrame(bool needCapture, int screenWidth, int screenHeight)
+{
+    frameUsesFBO_ = needCapture || compositionMode_ == CompositionMode::Offscreen;
+    if (frameUsesFBO_)
+    {
+        renderToFBO();
+    }
+    else
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, screenWidth, screenHeight);
+    }
+    return frameUsesFBO_;
+}
+
+/// @brief 1フレーム分の合成を終了する。FBOへ描画していた場合は画面へコピーする
+void Renderer::endFrame(int screenWidth, int screenHeight)
+{
+    if (frameUsesFBO_)
+    {
+        endOffscreenRender();
+        renderFBOToScreen(screenWidth, screenHeight);
+        frameUsesFBO_ = false;
     }
 }
 
@@ -189,13 +369,14 @@ void Renderer::renderFBOToScreen(int screenWidth, int screenHeight)
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glViewport(0, 0, screenWidth, screenHeight);
 
-    glUseProgram(fboRenderProgram_);
-    glBindTexture(GL_TEXTURE_2D, fboTexture_);
+    glState_->setBlendEnabled(false);
+    glState_->useProgram(fboRenderProgram_);
+    glState_->bindTexture(GL_TEXTURE0, fboTexture_);
+    glState_->uniform1i(fboRenderTextureLoc_, 0);
 
-    glBindBuffer(GL_ARRAY_BUFFER, fullScreenQuadVBO_);
-    GLint posLoc = glGetAttribLocation(fboRenderProgram_, "aPos");
-    glEnableVertexAttribArray(posLoc);
-    glVertexAttribPointer(posLoc, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    glState_->bindArrayBuffer(fullScreenQuadVBO_);
+    glState_->enableVertexAttribArray(fboRenderPositionLoc_);
+    glState_->vertexAttribPointer(fboRenderPositionLoc_, 2, 0, 0);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 }
 
@@ -208,56 +389,117 @@ bool Renderer::readPixelsFromFBO(std::vector<unsigned char> &outPixels, int widt
     return true;
 }
 
-void Renderer::uploadYUVTextures(const uint8_t *data, int width, int height, int ySize, int uSize)
+/// @brief 1プレーン分の画素データをテクスチャへアップロードする
+/// @note テクスチャのストレージは解像度や形式が変わった時（capsの変更時）だけglTexImage2Dで確保し直し、
+///       毎フレームはglTexSubImage2Dで中身だけを書き換える。テクスチャパラメータも確保時にだけ設定する。
+///       ストライドが幅より大きい（パディングがある）場合、GL_EXT_unpack_subimageが使えれば
+///       GL_UNPACK_ROW_LENGTH_EXTで行の間隔を指定して実画像部分だけをアップロードする。
+///       使えない場合はパディングごとアップロードし、シェーダ側でUVを縮めて切り取る。
+/// @return シェーダでU座標に掛ける倍率（実画像の幅 / テクスチャの幅）
+float Renderer::uploadPlane(PlaneTexture &texture, GLenum format, int bytesPerPixel,
+                            const VideoPlane &plane, int width, int height)
+{
+    int rowPixels = plane.stride > 0 ? plane.stride / bytesPerPixel : width;
+    int uploadWidth = width;
+    float texScale = 1.0f;
+
+    if (rowPixels != width)
+    {
+        if (hasUnpackSubimage_)
+        {
+            glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, rowPixels);
+        }
+        else
+        {
+            uploadWidth = rowPixels;
+            texScale = static_cast<float>(width) / static_cast<float>(rowPixels);
+        }
+    }
+
+    glState_->bindTexture(GL_TEXTURE0, texture.id);
+    if (texture.format != format || texture.width != uploadWidth || texture.height != height)
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, format, uploadWidth, height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        texture.format = format;
+        texture.width = uploadWidth;
+        texture.height = height;
+    }
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, uploadWidth, height, format, GL_UNSIGNED_BYTE, plane.data);
+
+    if (hasUnpackSubimage_ && rowPixels != width)
+    {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
+    }
+    return texScale;
+}
+
+void Renderer::uploadYUVTextures(const VideoPlane planes[3], int width, int height)
 {
-    const uint8_t *yPlane = data;
-    const uint8_t *uPlane = data + ySize;
-    const uint8_t *vPlane = data + ySize + uSize;
+    const int chromaWidth = (width + 1) / 2;
+    const int chromaHeight = (height + 1) / 2;
 
+    VideoTextureSet &set = acquireTextureSet();
+    ringStats_.uploads++;
+    set.format = VideoFormat::I420;
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-    glBindTexture(GL_TEXTURE_2D, yTex_);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width, height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, yPlane);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    set.lumaTexScale = uploadPlane(set.y, GL_LUMINANCE, 1, planes[0], width, height);
+    set.chromaTexScale = uploadPlane(set.u, GL_LUMINANCE, 1, planes[1], chromaWidth, chromaHeight);
+    uploadPlane(set.v, GL_LUMINANCE, 1, planes[2], chromaWidth, chromaHeight);
+}
 
-    glBindTexture(GL_TEXTURE_2D, uTex_);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width / 2, height / 2, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, uPlane);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+void Renderer::uploadNV12Textures(const VideoPlane planes[2], int width, int height)
+{
+    const int chromaWidth = (width + 1) / 2;
+    const int chromaHeight = (height + 1) / 2;
 
-    glBindTexture(GL_TEXTURE_2D, vTex_);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width / 2, height / 2, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, vPlane);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    VideoTextureSet &set = acquireTextureSet();
+    ringStats_.uploads++;
+    set.format = VideoFormat::NV12;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    set.lumaTexScale = uploadPlane(set.y, GL_LUMINANCE, 1, planes[0], width, height);
+    // UVは1画素2バイトのインターリーブなので、LUMINANCE_ALPHA として .r=U, .a=V で参照する
+    set.chromaTexScale = uploadPlane(set.uv, GL_LUMINANCE_ALPHA, 2, planes[1], chromaWidth, chromaHeight);
 }
 
 void Renderer::renderYUV(int screenWidth, int screenHeight)
 {
     glViewport(0, 0, screenWidth, screenHeight);
-    glUseProgram(yuvProgram_);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, yTex_);
-    glUniform1i(glGetUniformLocation(yuvProgram_, "texY"), 0);
+    VideoTextureSet &set = textureSets_[currentSet_];
+    const bool isNV12 = set.format == VideoFormat::NV12;
+    const VideoProgramLocations &locs = isNV12 ? nv12Locs_ : yuvLocs_;
 
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, uTex_);
-    glUniform1i(glGetUniformLocation(yuvProgram_, "texU"), 1);
+    // 映像は不透明なので、テロップが有効にしたブレンドは切っておく
+    glState_->setBlendEnabled(false);
+    glState_->useProgram(isNV12 ? nv12Program_ : yuvProgram_);
 
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, vTex_);
-    glUniform1i(glGetUniformLocation(yuvProgram_, "texV"), 2);
+    glState_->bindTexture(GL_TEXTURE0, set.y.id);
+    glState_->uniform1i(locs.texY, 0);
+    glState_->bindTexture(GL_TEXTURE1, isNV12 ? set.uv.id : set.u.id);
+    glState_->uniform1i(locs.texC0, 1);
+    if (!isNV12)
+    {
+        glState_->bindTexture(GL_TEXTURE2, set.v.id);
+        glState_->uniform1i(locs.texC1, 2);
+    }
+    glState_->uniform2f(locs.texScaleY, set.lumaTexScale, 1.0f);
+    glState_->uniform2f(locs.texScaleC, set.chromaTexScale, 1.0f);
 
-    glBindBuffer(GL_ARRAY_BUFFER, fullScreenQuadVBO_);
-    GLint posLoc = glGetAttribLocation(yuvProgram_, "aPos");
-    glEnableVertexAttribArray(posLoc);
-    glVertexAttribPointer(posLoc, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    glState_->bindArrayBuffer(fullScreenQuadVBO_);
+    glState_->enableVertexAttribArray(locs.position);
+    glState_->vertexAttribPointer(locs.position, 2, 0, 0);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    // このセットを参照する描画の後にフェンスを置き、次に上書きする前に完了を確認できるようにする
+    if (eglCreateSyncKHR_)
+    {
+        destroyFence(set);
+        set.fence = eglCreateSyncKHR_(eglDisplay_, EGL_SYNC_FENCE_KHR, nullptr);
+    }
 }
@@ -2,6 +2,7 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <cstdlib>
 
 GLuint createShader(GLenum type, const char *source)
 {
@@ -86,3 +87,14 @@ GLuint createProgramFromFiles(const char *vertexPath, const char *fragmentPath)
 
     return createProgram(vs.c_str(), fs.c_str());
 }
+
+std::string getShaderPath(const char *fileName)
+{
+    const char *dir = std::getenv("RASPI_GL_SHADER_DIR");
+    if (!dir || !*dir)
+    {
+        // make deploy でシェーダを転送する先
+        dir = "/home/h.itosu/shaders";
+    }
+    return std::string(dir) + "/" + fileName;
+}
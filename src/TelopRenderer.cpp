@@ -1,6 +1,8 @@
 // TelopRenderer.cpp
 #include "TelopRenderer.h"
 #include "ShaderUtils.h"
+#include "GLStateCache.h"
+#include "TextFeed.h"
 #include <GLES2/gl2.h>
 #include <iostream>
 #include <locale>
@@ -8,71 +10,200 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // アトラス1ページの一辺。CJKの64pxグリフなら1ページに200字程度入る
+    constexpr int kAtlasPageSize = 1024;
+    // グリフ間の透明な隙間。アウトラインの近傍サンプリングが隣のグリフに届かない幅にする
+    constexpr int kAtlasGutter = 8;
+
+    // SDFを生成する基準サイズと、輪郭の内外それぞれに持たせる距離の範囲（ピクセル）
+    constexpr int kSdfBaseSize = 64;
+    constexpr int kSdfSpread = 8;
+
+    // Lane::pendingFlags の値。0 はフィードが依頼していない（描画スレッドの requestedGlyphs_ で管理する）グリフ
+    constexpr uint8_t kFeedGlyphKnown = 1;     // フィードが以前に依頼した（生成中か、生成済み）
+    constexpr uint8_t kFeedGlyphRequested = 2; // フィードがこのレイアウトを組む時に依頼した
+
+    // ストリップ1タイルの最大幅。GL_MAX_TEXTURE_SIZE がこれより小さければそちらに合わせる
+    constexpr int kStripMaxTileWidth = 4096;
+
+    // グリフ頂点: 位置(2) + UV(2) + 文字色(4) + 拡大率(1)
+    constexpr int kGlyphVertexFloats = 9;
+    // ストリップ頂点: 位置(2) + UV(2)
+    constexpr int kStripVertexFloats = 4;
+}
 
 TelopRenderer::TelopRenderer()
-    : library_(nullptr), face_(nullptr), telopProgram_(0), attrPosition_(-1), attrTexCoord_(-1),
+    : telopProgram_(0), attrPosition_(-1), attrTexCoord_(-1),
       uniformResolution_(-1), uniformTexture_(-1), uniformOutlineColor_(-1), uniformTextureSize_(-1),
       uniformMarginSize_(-1), // ← 追加
-      vbo_(0), scrollX_(0.0f), startTime_(std::chrono::steady_clock::now()), screenWidth_(1280), screenHeight_(720),
+      vbo_(0), screenWidth_(1280), screenHeight_(720),
       outlineEnabled_(false), outlinePixelWidth_(1.0f), marginSize_(4.0f) // ← デフォルトマージン指定
 {
     outlineColor_[0] = 0.0f;
     outlineColor_[1] = 0.0f;
     outlineColor_[2] = 0.0f;
     outlineColor_[3] = 1.0f;
+
+    // レーン0: 画面下端を流れるティッカー（従来の1行テロップ）
+    addLane();
+    lanes_[0].baselineY = screenHeight_ - 64.0f;
+    lanes_[0].speed = 100.0f;
 }
 TelopRenderer::~TelopRenderer()
 {
-    for (auto &entry : glyphCache_)
+    if (glState_)
     {
-        glDeleteTextures(1, &entry.second.textureID);
+        for (Lane &lane : lanes_)
+            destroyStripTiles(lane);
     }
+    if (stripFbo_)
+        glDeleteFramebuffers(1, &stripFbo_);
+    rasterizer_.stop();
+    atlas_.shutdown();
     glyphCache_.clear();
-
-    if (face_)
-        FT_Done_Face(face_);
-    if (library_)
-        FT_Done_FreeType(library_);
     if (vbo_)
         glDeleteBuffers(1, &vbo_);
 }
 
 void TelopRenderer::setupDefaultUniforms()
 {
-    glUseProgram(telopProgram_);
+    glState_->useProgram(telopProgram_);
 
-    glUniform4f(uniformTextColor_, 1.0f, 1.0f, 1.0f, 1.0f); // 白色 + フルアルファ    glUniform2f(uniformResolution_, (float)screenWidth_, (float)screenHeight_);
-    glUniform4f(uniformOutlineColor_, 0.0f, 0.0f, 0.0f, 1.0f);
-    glUniform1i(uniformEnableOutline_, outlineEnabled_ ? 1 : 0); // アウトライン有効化フラグ
-    glUniform1f(uniformOutlinePixelWidth_, 1.0f);
+    // 文字色はレーン毎に頂点属性で渡す
+    glState_->uniform4f(uniformOutlineColor_, 0.0f, 0.0f, 0.0f, 1.0f);
+    glState_->uniform1i(uniformEnableOutline_, outlineEnabled_ ? 1 : 0); // アウトライン有効化フラグ
+    glState_->uniform1f(uniformOutlinePixelWidth_, 1.0f);
 
-    glUniform1f(uniformMarginSize_, marginSize_);
+    glState_->uniform1f(uniformMarginSize_, marginSize_);
+    glState_->uniform1f(uniformSdfSpread_, static_cast<float>(kSdfSpread));
 
     // プレースホルダー：描画対象に応じて更新する部分
-    glUniform2f(uniformTextureSize_, 64.0f, 64.0f); // 仮サイズ（実描画時に上書きされる）
-    glUniform1i(uniformTexture_, 0);                // GL_TEXTURE0 に固定
+    glState_->uniform2f(uniformTextureSize_, 64.0f, 64.0f); // 仮サイズ（実描画時に上書きされる）
+    glState_->uniform1i(uniformTexture_, 0);                // GL_TEXTURE0 に固定
+}
+
+void TelopRenderer::setGlyphMode(GlyphMode mode)
+{
+    glyphMode_ = mode;
+}
+
+void TelopRenderer::setGlyphWorkers(int count)
+{
+    glyphWorkers_ = std::max(count, 1);
+}
+
+void TelopRenderer::setGlyphUploadBudget(int count)
+{
+    uploadBudget_ = std::max(count, 1);
+}
+
+int TelopRenderer::addFont(const char *fontPath)
+{
+    extraFontPaths_.push_back(fontPath);
+    return static_cast<int>(extraFontPaths_.size());
+}
+
+void TelopRenderer::setFontFace(int face)
+{
+    fontFace_ = face;
+    restyleText();
+}
+
+void TelopRenderer::setScrollMode(ScrollMode mode)
+{
+    scrollMode_ = mode;
+    markStripsDirty();
+}
+
+void TelopRenderer::setScreenSize(int width, int height)
+{
+    // 既定位置のままのティッカーは新しい画面の下端へ移す
+    if (lanes_[0].baselineY == screenHeight_ - 64.0f)
+        lanes_[0].baselineY = height - 64.0f;
+    screenWidth_ = width;
+    screenHeight_ = height;
+}
+
+float TelopRenderer::getGlyphScale(const Lane &lane) const
+{
+    return glyphMode_ == GlyphMode::SDF ? static_cast<float>(lane.fontPixelSize) / kSdfBaseSize : 1.0f;
+}
+
+int TelopRenderer::addLane()
+{
+    Lane lane;
+    lane.baselineY = 64.0f;
+    lane.startTime = std::chrono::steady_clock::now();
+    lanes_.push_back(lane);
+    return static_cast<int>(lanes_.size()) - 1;
+}
+
+int TelopRenderer::getLaneCount() const
+{
+    return static_cast<int>(lanes_.size());
 }
 
-bool TelopRenderer::initialize(const char *fontPath)
+TelopRenderer::Lane *TelopRenderer::findLane(int lane)
 {
-    if (FT_Init_FreeType(&library_) != 0)
+    if (lane < 0 || lane >= static_cast<int>(lanes_.size()))
     {
-        std::cerr << "Failed to initialize FreeType library." << std::endl;
-        return false;
+        std::cerr << "[TelopRenderer] Invalid lane: " << lane << std::endl;
+        return nullptr;
+    }
+    return &lanes_[lane];
+}
+
+void TelopRenderer::setLanePosition(int lane, float x, float baselineY)
+{
+    if (Lane *target = findLane(lane))
+    {
+        target->x = x;
+        target->baselineY = baselineY;
     }
+}
 
-    if (FT_New_Face(library_, fontPath, 0, &face_) != 0)
+void TelopRenderer::setLaneColor(int lane, float r, float g, float b, float a)
+{
+    if (Lane *target = findLane(lane))
+    {
+        target->color[0] = r;
+        target->color[1] = g;
+        target->color[2] = b;
+        target->color[3] = a;
+        target->stripDirty = true; // ストリップには色ごと描き込んでいる
+    }
+}
+
+void TelopRenderer::setLaneScrollSpeed(int lane, float pixelsPerSecond)
+{
+    if (Lane *target = findLane(lane))
+    {
+        target->speed = std::max(pixelsPerSecond, 0.0f);
+        target->startTime = std::chrono::steady_clock::now();
+        target->hasPreviousPenX = false;
+    }
+}
+
+bool TelopRenderer::initialize(const char *fontPath, GLStateCache &glState)
+{
+    glState_ = &glState;
+    std::vector<std::string> fontPaths(1, fontPath);
+    fontPaths.insert(fontPaths.end(), extraFontPaths_.begin(), extraFontPaths_.end());
+    if (!rasterizer_.start(fontPaths, glyphWorkers_))
     {
         std::cerr << "Failed to load font: " << fontPath << std::endl;
         return false;
     }
     std::cout << "Font loaded: " << fontPath << std::endl;
 
-    FT_Set_Pixel_Sizes(face_, 0, 64);
-
-    const char *vertexPath = "/home/h.itosu/shaders/telop.vert";
-    const char *fragmentPath = "/home/h.itosu/shaders/telop.frag";
-    telopProgram_ = createProgramFromFiles(vertexPath, fragmentPath);
+    const std::string vertexPath = getShaderPath("telop.vert");
+    const std::string fragmentPath = getShaderPath(glyphMode_ == GlyphMode::SDF ? "telop_sdf.frag" : "telop.frag");
+    telopProgram_ = createProgramFromFiles(vertexPath.c_str(), fragmentPath.c_str());
     if (!telopProgram_)
     {
         std::cerr << "Failed to create shader program from " << vertexPath << " and " << fragmentPath << std::endl;
@@ -81,14 +212,56 @@ bool TelopRenderer::initialize(const char *fontPath)
 
     attrPosition_ = glGetAttribLocation(telopProgram_, "a_position");
     attrTexCoord_ = glGetAttribLocation(telopProgram_, "a_texcoord");
+    attrColor_ = glGetAttribLocation(telopProgram_, "a_color");
+    attrGlyphScale_ = glGetAttribLocation(telopProgram_, "a_glyphScale");
     uniformResolution_ = glGetUniformLocation(telopProgram_, "u_resolution");
     uniformTexture_ = glGetUniformLocation(telopProgram_, "u_texture");
     uniformOutlineColor_ = glGetUniformLocation(telopProgram_, "u_outlineColor");
     uniformTextureSize_ = glGetUniformLocation(telopProgram_, "u_textureSize");
     uniformMarginSize_ = glGetUniformLocation(telopProgram_, "u_marginPixelSize");
-    uniformTextColor_ = glGetUniformLocation(telopProgram_, "u_textColor");
     uniformOutlinePixelWidth_ = glGetUniformLocation(telopProgram_, "u_outlinePixelWidth");
     uniformEnableOutline_ = glGetUniformLocation(telopProgram_, "u_enableOutline");
+    uniformSdfSpread_ = glGetUniformLocation(telopProgram_, "u_sdfSpread");
+
+    atlas_.initialize(glState, kAtlasPageSize, kAtlasGutter);
+    // 予算をページ数に換算する（最低1ページ）
+    const size_t pageBytes = static_cast<size_t>(atlas_.getPageSize()) * atlas_.getPageSize();
+    atlas_.setMaxPages(static_cast<int>(std::max<size_t>(glyphCacheBudget_ / pageBytes, 1)));
+
+    if (!glyphCacheFile_.empty())
+    {
+        // 前回保存したアトラスがあれば、そのままテクスチャに転送して使う
+        const auto loadStart = std::chrono::steady_clock::now();
+        glyphCacheIdentity_.fontHashes.clear();
+        for (const std::string &path : fontPaths)
+            glyphCacheIdentity_.fontHashes.push_back(GlyphCacheFile::hashFont(path));
+        glyphCacheIdentity_.pageSize = atlas_.getPageSize();
+        glyphCacheIdentity_.gutter = kAtlasGutter;
+        glyphCacheIdentity_.sdfBaseSize = kSdfBaseSize;
+        glyphCacheIdentity_.sdfSpread = kSdfSpread;
+        atlas_.setKeepPixels(true);
+        if (GlyphCacheFile::load(glyphCacheFile_, glyphCacheIdentity_, atlas_, glyphCache_))
+        {
+            std::cout << "[TelopRenderer] Glyph cache file loaded in "
+                      << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count()
+                      << " ms" << std::endl;
+        }
+    }
+
+    if (scrollMode_ == ScrollMode::Strip)
+    {
+        const std::string stripFragmentPath = getShaderPath("telop_strip.frag");
+        stripProgram_ = createProgramFromFiles(vertexPath.c_str(), stripFragmentPath.c_str());
+        if (!stripProgram_)
+        {
+            std::cerr << "Failed to create shader program from " << vertexPath << " and " << stripFragmentPath << std::endl;
+            return false;
+        }
+        stripAttrPosition_ = glGetAttribLocation(stripProgram_, "a_position");
+        stripAttrTexCoord_ = glGetAttribLocation(stripProgram_, "a_texcoord");
+        stripUniformResolution_ = glGetUniformLocation(stripProgram_, "u_resolution");
+        stripUniformTexture_ = glGetUniformLocation(stripProgram_, "u_texture");
+    }
 
     glGenBuffers(1, &vbo_);
     setupDefaultUniforms();
@@ -98,9 +271,20 @@ bool TelopRenderer::initialize(const char *fontPath)
 
 void TelopRenderer::SetFontSize(int size)
 {
-    if (face_)
+    setLaneFontSize(0, size);
+}
+
+void TelopRenderer::setLaneFontSize(int lane, int size)
+{
+    Lane *target = findLane(lane);
+    if (!target)
+        return;
+    if (rasterizer_.isRunning())
     {
-        FT_Set_Pixel_Sizes(face_, 0, size);
+        // 以降にラスタライズするグリフのサイズになる（SDFは生成済みの距離場を拡大縮小する）
+        target->fontPixelSize = size;
+        target->stripDirty = true;
+        restyleText();
         std::cout << "Font size set to: " << size << std::endl;
     }
     else
@@ -112,6 +296,13 @@ void TelopRenderer::SetFontSize(int size)
 void TelopRenderer::setOutline(bool enabled)
 {
     outlineEnabled_ = enabled;
+    markStripsDirty();
+}
+
+void TelopRenderer::markStripsDirty()
+{
+    for (Lane &lane : lanes_)
+        lane.stripDirty = true;
 }
 
 void TelopRenderer::setOutlineColor(float r, float g, float b, float a)
@@ -120,190 +311,864 @@ void TelopRenderer::setOutlineColor(float r, float g, float b, float a)
     outlineColor_[1] = g;
     outlineColor_[2] = b;
     outlineColor_[3] = a;
+    markStripsDirty();
 }
 
 void TelopRenderer::setOutlinePixelWidth(float width)
 {
     outlinePixelWidth_ = width;
+    markStripsDirty();
+    restyleText();
 }
 
 void TelopRenderer::setMarginSize(float size)
 {
     marginSize_ = size;
+    markStripsDirty();
 }
 
 void TelopRenderer::SetText(const std::string &text)
 {
-    currentText_ = text;
+    setLaneText(0, text);
+}
+
+void TelopRenderer::setLaneText(int lane, const std::string &text)
+{
+    Lane *target = findLane(lane);
+    if (!target)
+        return;
+    if (!rasterizer_.isRunning())
+    {
+        std::cerr << "Font face not initialized." << std::endl;
+        return;
+    }
+
+    target->currentText = text;
     std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
-    text_ = converter.from_bytes(text);
+    target->pendingText = converter.from_bytes(text);
+    beginPendingText(*target);
+}
 
-    for (wchar_t c : text_)
+void TelopRenderer::beginPendingText(Lane &lane)
+{
+    lane.pendingStyle = currentStyle(lane);
+    lane.pendingFromFeed = false;
+    lane.textPending = true;
+    lane.pendingKeys.clear();
+    lane.pendingFlags.assign(lane.pendingText.size(), 0);
+
+    // 未生成のグリフはワーカーへ依頼し、揃うまでは今の文字列を表示し続ける
+    updatePinnedGlyphs();
+    for (wchar_t c : lane.pendingText)
     {
-        loadGlyph(c);
+        const GlyphCache::Key key = glyphKey(lane.pendingStyle, c);
+        lane.pendingKeys.push_back(key);
+        // 失敗の原因がキャッシュの予算不足だった場合に備えて、この文字列のグリフだけは改めて生成を試みる
+        // （他のレーンの表示待ちの文字列が頼りにしている失敗の記録は消さない）
+        failedGlyphs_.erase(key);
+        requestGlyph(lane.pendingStyle, c);
     }
+    applyPendingTextIfReady(lane);
 }
 
-void TelopRenderer::update()
+void TelopRenderer::attachTextFeed(TextFeed *feed, int lane)
+{
+    Lane *target = findLane(lane);
+    if (feed && !target)
+        return;
+    if (textFeed_)
+        textFeed_->setLayoutBuilder(nullptr);
+    textFeed_ = feed;
+    textFeedLane_ = lane;
+    if (!feed)
+        return;
+    feedStyle_.store(glyphKey(currentStyle(*target), 0), std::memory_order_relaxed);
+    feed->setLayoutBuilder([this](TextFeed::Layout &layout) { buildFeedLayout(layout); });
+}
+
+void TelopRenderer::buildFeedLayout(TextFeed::Layout &layout)
+{
+    // フィードのスレッドで呼ばれる。描画スレッドが追い出したグリフは、次に使う時に改めて依頼できるよう記録から消す
+    layout.generation = feedGeneration_.load(std::memory_order_acquire);
+    if (feedForgetAll_.exchange(false, std::memory_order_acq_rel))
+        feedRequested_.clear();
+    GlyphCache::Key dropped;
+    while (feedDroppedGlyphs_.pop(dropped))
+        feedRequested_.erase(dropped);
+
+    // キーの並びを組み、まだ依頼していないグリフはここでワーカーへ依頼する
+    layout.style = feedStyle_.load(std::memory_order_relaxed);
+    const GlyphStyle style = styleFromKey(layout.style);
+    layout.glyphKeys.reserve(layout.text.size());
+    layout.glyphFlags.reserve(layout.text.size());
+    for (wchar_t c : layout.text)
+    {
+        const GlyphCache::Key key = layout.style | static_cast<uint32_t>(c);
+        layout.glyphKeys.push_back(key);
+        if (feedRequested_.insert(key).second)
+        {
+            rasterizer_.request(makeGlyphRequest(style, c));
+            layout.glyphFlags.push_back(kFeedGlyphRequested);
+        }
+        else
+        {
+            layout.glyphFlags.push_back(kFeedGlyphKnown);
+        }
+    }
+}
+
+void TelopRenderer::forgetFeedGlyph(GlyphCache::Key key)
+{
+    if (!textFeed_)
+        return;
+    if (!feedDroppedGlyphs_.push(std::move(key)))
+        feedForgetAll_.store(true, std::memory_order_relaxed);
+    feedGeneration_.fetch_add(1, std::memory_order_release);
+}
+
+void TelopRenderer::forgetAllFeedGlyphs()
+{
+    if (!textFeed_)
+        return;
+    feedForgetAll_.store(true, std::memory_order_relaxed);
+    feedGeneration_.fetch_add(1, std::memory_order_release);
+}
+
+void TelopRenderer::pollTextFeed()
+{
+    if (!textFeed_ || !rasterizer_.isRunning())
+        return;
+
+    // フィードのスレッドが次の文字列を組む時のスタイル
+    Lane &lane = lanes_[textFeedLane_];
+    const GlyphStyle style = currentStyle(lane);
+    feedStyle_.store(glyphKey(style, 0), std::memory_order_relaxed);
+    if (!textFeed_->poll(feedLayout_))
+        return;
+
+    // フィードのスレッドで組み済みのレイアウトを入れ替えるだけで受け取る。古い領域はフィードの次の受信で再利用される
+    lane.currentText.swap(feedLayout_.utf8);
+    lane.pendingText.swap(feedLayout_.text);
+    lane.pendingKeys.swap(feedLayout_.glyphKeys);
+    lane.pendingFlags.swap(feedLayout_.glyphFlags);
+    lane.pendingStyle = styleFromKey(feedLayout_.style);
+    lane.pendingGeneration = feedLayout_.generation;
+    lane.pendingFromFeed = true;
+    lane.textPending = true;
+    updatePinnedGlyphs();
+    if (!(lane.pendingStyle == style))
+    {
+        // 組んだ後でスタイルが変わった（まれ）。描画スレッドで組み直す
+        beginPendingText(lane);
+        return;
+    }
+
+    // フィードが改めて依頼したグリフは、以前の失敗の記録を消して結果を待つ。
+    // setLaneText() と同じく、受け取った文字列毎にヒット/ミスを数えて LRU の順序を進める
+    for (size_t i = 0; i < lane.pendingKeys.size(); ++i)
+    {
+        glyphCache_.lookup(lane.pendingKeys[i]);
+        if (lane.pendingFlags[i] == kFeedGlyphRequested)
+            failedGlyphs_.erase(lane.pendingKeys[i]);
+    }
+    applyPendingTextIfReady(lane);
+}
+
+TelopRenderer::GlyphStyle TelopRenderer::currentStyle(const Lane &lane) const
+{
+    GlyphStyle style;
+    style.face = fontFace_;
+    if (glyphMode_ == GlyphMode::SDF)
+    {
+        // SDFはサイズとアウトライン幅を描画時に決めるので、フォント毎に1種類だけ持てばよい
+        style.pixelSize = kSdfBaseSize;
+        style.padding = kSdfSpread;
+        style.sdf = true;
+    }
+    else
+    {
+        // アウトライン幅の分だけパディングを追加する
+        style.pixelSize = lane.fontPixelSize;
+        style.padding = static_cast<int>(outlinePixelWidth_) + 1;
+    }
+    return style;
+}
+
+TelopRenderer::GlyphStyle TelopRenderer::styleFromKey(GlyphCache::Key key)
+{
+    GlyphStyle style;
+    style.padding = static_cast<int>((key >> 32) & 0xFF);
+    style.pixelSize = static_cast<int>((key >> 40) & 0xFFF);
+    style.face = static_cast<int>((key >> 52) & 0xFF);
+    style.sdf = ((key >> 60) & 1) != 0;
+    return style;
+}
+
+GlyphCache::Key TelopRenderer::glyphKey(const GlyphStyle &style, wchar_t c)
+{
+    // 文字コード32bit | 余白8bit | ピクセルサイズ12bit | フォント番号8bit | SDF 1bit
+    return static_cast<uint64_t>(static_cast<uint32_t>(c)) |
+           (static_cast<uint64_t>(style.padding & 0xFF) << 32) |
+           (static_cast<uint64_t>(style.pixelSize & 0xFFF) << 40) |
+           (static_cast<uint64_t>(style.face & 0xFF) << 52) |
+           (static_cast<uint64_t>(style.sdf ? 1 : 0) << 60);
+}
+
+void TelopRenderer::restyleText()
+{
+    // スタイルが変わったら、今のテキストを新しいスタイルのグリフで組み直す（生成済みのスタイルなら即座に切り替わる）
+    for (size_t i = 0; i < lanes_.size(); ++i)
+    {
+        const Lane &lane = lanes_[i];
+        const GlyphStyle &shown = lane.textPending ? lane.pendingStyle : lane.textStyle;
+        if (!lane.currentText.empty() && rasterizer_.isRunning() && !(currentStyle(lane) == shown))
+            setLaneText(static_cast<int>(i), lane.currentText);
+    }
+}
+
+void TelopRenderer::requestGlyph(const GlyphStyle &style, wchar_t c)
+{
+    const GlyphCache::Key key = glyphKey(style, c);
+    if (glyphCache_.lookup(key) || failedGlyphs_.count(key) || !requestedGlyphs_.insert(key).second)
+        return;
+    rasterizer_.request(makeGlyphRequest(style, c));
+}
+
+GlyphRasterizer::Request TelopRenderer::makeGlyphRequest(const GlyphStyle &style, wchar_t c)
+{
+    GlyphRasterizer::Request request;
+    request.code = c;
+    request.face = style.face;
+    request.pixelSize = style.pixelSize;
+    request.padding = style.padding;
+    if (style.sdf)
+    {
+        request.format = GlyphRasterizer::Format::SDF;
+        request.sdfSpread = kSdfSpread;
+    }
+    return request;
+}
+
+void TelopRenderer::processRasterizedGlyphs()
+{
+    GlyphRasterizer::Result result;
+    while (rasterizer_.poll(result))
+    {
+        readyGlyphs_.push_back(std::move(result));
+    }
+
+    // 大量の新しい文字が届いてもフレームを落とさないよう、1フレームのアップロード数を制限する
+    for (int uploaded = 0; uploaded < uploadBudget_ && !readyGlyphs_.empty(); ++uploaded)
+    {
+        uploadGlyph(readyGlyphs_.front());
+        readyGlyphs_.pop_front();
+    }
+
+    for (Lane &lane : lanes_)
+    {
+        if (lane.textPending)
+            applyPendingTextIfReady(lane);
+    }
+}
+
+bool TelopRenderer::applyPendingTextIfReady(Lane &lane)
 {
-    auto now = std::chrono::steady_clock::now();
-    float elapsed = std::chrono::duration<float>(now - startTime_).count();
-    float totalWidth = 0.0f;
-    for (wchar_t c : text_)
+    // フィードがレイアウトを組んだ後でグリフを追い出していれば、依頼済みの印は当てにならない
+    const bool flagsCurrent =
+        !lane.pendingFromFeed || lane.pendingGeneration == feedGeneration_.load(std::memory_order_relaxed);
+
+    // 文字列の送り幅も同じ走査で集計する（update()で毎フレーム辿らない）
+    bool ready = true;
+    float advance = 0.0f;
+    for (size_t i = 0; i < lane.pendingKeys.size(); ++i)
     {
-        auto it = glyphCache_.find(c);
-        if (it != glyphCache_.end())
-            totalWidth += it->second.advance;
+        const GlyphCache::Key key = lane.pendingKeys[i];
+        if (const Glyph *glyph = glyphCache_.find(key))
+        {
+            advance += glyph->advance;
+            continue;
+        }
+        if (failedGlyphs_.count(key))
+            continue;
+        ready = false;
+        // 生成待ちでもないグリフ（追い出された場合など）は依頼し直し、いつまでも揃わない状態を避ける
+        if ((lane.pendingFlags[i] != 0 && flagsCurrent) || requestedGlyphs_.count(key))
+            continue;
+        requestGlyph(lane.pendingStyle, lane.pendingText[i]);
     }
+    if (!ready)
+        return false;
+
+    // 今まで表示していた文字列のグリフは表示を終える時点で使ったものとし、長く表示した文字ほど追い出されにくくする
+    // （表示中は pinned で守られ、LRU の順序は文字列を受け取った時点のまま止まっているため）
+    for (wchar_t c : lane.text)
+        glyphCache_.touch(glyphKey(lane.textStyle, c));
+
+    lane.text.swap(lane.pendingText);
+    lane.textStyle = lane.pendingStyle;
+    lane.pendingText.clear();
+    lane.pendingKeys.clear();
+    lane.pendingFlags.clear();
+    lane.pendingFromFeed = false;
+    lane.textPending = false;
+    lane.lineAdvance = advance;
+    lane.stripDirty = true;
+    updatePinnedGlyphs();
+    return true;
+}
 
-    scrollX_ = screenWidth_ - elapsed * 100.0f;
-    if (scrollX_ < -totalWidth)
+void TelopRenderer::update()
+{
+    update(std::chrono::steady_clock::now());
+}
+
+void TelopRenderer::update(std::chrono::steady_clock::time_point presentTime)
+{
+    // フィードからの文字列はフレームの区切りでだけ受け取る
+    pollTextFeed();
+    processRasterizedGlyphs();
+
+    const double idealStep = std::chrono::duration<double>(refreshInterval_).count();
+    for (Lane &lane : lanes_)
     {
-        startTime_ = now;
-        scrollX_ = screenWidth_;
+        if (lane.speed <= 0.0f)
+        {
+            lane.penX = lane.x;
+            lane.hasPreviousPenX = false;
+            continue;
+        }
+
+        // 位置は表示時刻の関数にする。描画処理の開始時刻の揺れは位置に影響しない
+        const float totalWidth = lane.lineAdvance * getGlyphScale(lane);
+        double elapsed = std::chrono::duration<double>(presentTime - lane.startTime).count();
+        bool wrapped = false;
+        if (screenWidth_ - elapsed * lane.speed < -totalWidth)
+        {
+            // 1周分だけ起点を進める（起点を現在時刻に置き直すと、その分だけ動きが途切れる）
+            const double cycle = (screenWidth_ + totalWidth) / lane.speed;
+            const double cycles = std::floor(elapsed / cycle);
+            lane.startTime += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(cycles * cycle));
+            elapsed -= cycles * cycle;
+            wrapped = true;
+        }
+        lane.penX = static_cast<float>(screenWidth_ - elapsed * lane.speed);
+
+        if (lane.hasPreviousPenX && !wrapped)
+        {
+            const double error = std::fabs((lane.previousPenX - lane.penX) - lane.speed * idealStep);
+            jitterFrames_++;
+            jitterErrorSum_ += error;
+            jitterErrorMax_ = std::max(jitterErrorMax_, error);
+        }
+        lane.previousPenX = lane.penX;
+        lane.hasPreviousPenX = true;
     }
 }
 
+void TelopRenderer::setRefreshInterval(std::chrono::nanoseconds interval)
+{
+    if (interval.count() > 0)
+        refreshInterval_ = interval;
+}
+
+TelopRenderer::ScrollJitterStats TelopRenderer::getScrollJitterStats() const
+{
+    ScrollJitterStats stats;
+    stats.frames = jitterFrames_;
+    stats.meanErrorPx = jitterFrames_ > 0 ? jitterErrorSum_ / jitterFrames_ : 0.0;
+    stats.maxErrorPx = jitterErrorMax_;
+    return stats;
+}
+
+void TelopRenderer::resetScrollJitterStats()
+{
+    jitterFrames_ = 0;
+    jitterErrorSum_ = 0.0;
+    jitterErrorMax_ = 0.0;
+}
+
 void TelopRenderer::render()
 {
-    float x = scrollX_;
-    float y = screenHeight_ - 64.0f;
+    if (scrollMode_ == ScrollMode::Strip)
+    {
+        bool built = true;
+        for (Lane &lane : lanes_)
+        {
+            if (lane.stripDirty && !buildStrip(lane))
+            {
+                built = false;
+                break;
+            }
+        }
+        if (!built)
+        {
+            // ストリップを作れない場合はグリフ毎の描画に切り替える
+            std::cerr << "[TelopRenderer] Falling back to per-glyph scrolling." << std::endl;
+            scrollMode_ = ScrollMode::Glyphs;
+            for (Lane &lane : lanes_)
+                destroyStripTiles(lane);
+        }
+        else
+        {
+            renderStrips();
+            return;
+        }
+    }
+
+    // 全レーンのグリフを1つのバッチに集め、1回の転送とページ毎の描画で済ませる
+    glState_->useProgram(telopProgram_);
+    glState_->setBlendEnabled(true);
+    glState_->blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    beginGlyphBatch(screenWidth_, screenHeight_);
+    for (const Lane &lane : lanes_)
+    {
+        appendLaneGlyphs(lane, lane.penX, lane.baselineY, screenWidth_);
+    }
+    drawGlyphBatch();
+}
+
+void TelopRenderer::beginGlyphBatch(int viewWidth, int viewHeight)
+{
+    // 全グリフで共通のステートを設定する
+    glState_->uniform2f(uniformResolution_, (float)viewWidth, (float)viewHeight);
+    glState_->uniform4f(uniformOutlineColor_, outlineColor_[0], outlineColor_[1], outlineColor_[2], outlineColor_[3]);
+    glState_->uniform1f(uniformOutlinePixelWidth_, outlineEnabled_ ? outlinePixelWidth_ : 0.0f);
+    glState_->uniform1i(uniformEnableOutline_, outlineEnabled_ ? 1 : 0);
+    glState_->uniform1f(uniformMarginSize_, marginSize_);
+    glState_->uniform1i(uniformTexture_, 0);
+    // アウトラインの近傍サンプリング幅はアトラスページのテクセル単位で計算する
+    glState_->uniform2f(uniformTextureSize_, (float)atlas_.getPageSize(), (float)atlas_.getPageSize());
+    // SDFのぼかし幅とアウトライン幅は、頂点の拡大率と距離場の範囲からシェーダ側で求める
+    glState_->uniform1f(uniformSdfSpread_, static_cast<float>(kSdfSpread));
 
-    for (wchar_t c : text_)
+    pageVertices_.resize(atlas_.getPageCount());
+    for (std::vector<float> &vertices : pageVertices_)
     {
-        auto it = glyphCache_.find(c);
-        if (it != glyphCache_.end())
+        vertices.clear();
+    }
+}
+
+void TelopRenderer::appendLaneGlyphs(const Lane &lane, float penX, float baselineY, int viewWidth)
+{
+    // 描画範囲に掛かるグリフだけをページ毎の頂点配列に集める
+    const float scale = getGlyphScale(lane);
+    float x = penX;
+    for (wchar_t c : lane.text)
+    {
+        const Glyph *cached = glyphCache_.find(glyphKey(lane.textStyle, c));
+        if (!cached)
+            continue;
+        const Glyph &glyph = *cached;
+        float left = x + glyph.bearingX * scale;
+        if (left + glyph.width * scale >= 0.0f && left <= viewWidth)
         {
-            renderGlyph(it->second, x, y, 1.0f);
-            x += it->second.advance;
+            appendGlyphQuad(glyph, x, baselineY, scale, lane.color, pageVertices_[glyph.region.page]);
         }
+        x += glyph.advance * scale;
+    }
+}
+
+void TelopRenderer::drawGlyphBatch()
+{
+    // ページ順に連結して1回で転送し、ページ毎に1回ずつ描画する
+    batchVertices_.clear();
+    for (const std::vector<float> &vertices : pageVertices_)
+    {
+        batchVertices_.insert(batchVertices_.end(), vertices.begin(), vertices.end());
     }
+    if (batchVertices_.empty())
+        return;
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glUseProgram(0);
+    glState_->bindArrayBuffer(vbo_);
+    glBufferData(GL_ARRAY_BUFFER, batchVertices_.size() * sizeof(float), batchVertices_.data(), GL_DYNAMIC_DRAW);
+
+    const GLsizei stride = sizeof(float) * kGlyphVertexFloats;
+    glState_->enableVertexAttribArray(attrPosition_);
+    glState_->vertexAttribPointer(attrPosition_, 2, stride, 0);
+    glState_->enableVertexAttribArray(attrTexCoord_);
+    glState_->vertexAttribPointer(attrTexCoord_, 2, stride, sizeof(float) * 2);
+    glState_->enableVertexAttribArray(attrColor_);
+    glState_->vertexAttribPointer(attrColor_, 4, stride, sizeof(float) * 4);
+    if (attrGlyphScale_ >= 0)
+    {
+        glState_->enableVertexAttribArray(attrGlyphScale_);
+        glState_->vertexAttribPointer(attrGlyphScale_, 1, stride, sizeof(float) * 8);
+    }
+
+    GLint first = 0;
+    for (size_t page = 0; page < pageVertices_.size(); ++page)
+    {
+        GLsizei count = static_cast<GLsizei>(pageVertices_[page].size() / kGlyphVertexFloats);
+        if (count == 0)
+            continue;
+        glState_->bindTexture(GL_TEXTURE0, atlas_.getPageTexture(static_cast<int>(page)));
+        glDrawArrays(GL_TRIANGLES, first, count);
+        first += count;
+    }
+
+    // 次に描画するパスは必要なステートだけをキャッシュ経由で設定するので、ここでバインドを解除しない
+    if (attrGlyphScale_ >= 0)
+        glState_->disableVertexAttribArray(attrGlyphScale_);
+    glState_->disableVertexAttribArray(attrColor_);
+    glState_->disableVertexAttribArray(attrTexCoord_);
+    glState_->disableVertexAttribArray(attrPosition_);
 }
 
-bool TelopRenderer::loadGlyph(wchar_t c)
+bool TelopRenderer::buildStrip(Lane &lane)
 {
-    if (glyphCache_.count(c))
-        return true;
+    destroyStripTiles(lane);
+    lane.stripDirty = false;
 
-    if (FT_Load_Char(face_, c, FT_LOAD_RENDER))
+    // 文字列全体の外接矩形を求め、ペンの開始位置とベースラインをストリップ内に決める
+    const float scale = getGlyphScale(lane);
+    float pen = 0.0f;
+    float minLeft = 0.0f;
+    float maxRight = 0.0f;
+    float ascent = 0.0f;
+    float descent = 0.0f;
+    for (wchar_t c : lane.text)
+    {
+        const Glyph *cached = glyphCache_.find(glyphKey(lane.textStyle, c));
+        if (!cached)
+            continue;
+        const Glyph &glyph = *cached;
+        float left = pen + glyph.bearingX * scale;
+        minLeft = std::min(minLeft, left);
+        maxRight = std::max(maxRight, left + glyph.width * scale);
+        ascent = std::max(ascent, glyph.bearingY * scale);
+        descent = std::max(descent, (glyph.height - glyph.bearingY) * scale);
+        pen += glyph.advance * scale;
+    }
+    lane.stripOriginX = std::ceil(-minLeft);
+    lane.stripBaseline = std::ceil(ascent);
+    lane.stripHeight = static_cast<int>(lane.stripBaseline + std::ceil(descent));
+    const int stripWidth = static_cast<int>(std::ceil(maxRight + lane.stripOriginX));
+    if (stripWidth <= 0 || lane.stripHeight <= 0)
+        return true; // 空文字列。何も描かない
+
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    if (lane.stripHeight > maxTextureSize)
+    {
+        std::cerr << "[TelopRenderer] Telop strip height " << lane.stripHeight << " exceeds GL_MAX_TEXTURE_SIZE." << std::endl;
         return false;
+    }
+    const int tileWidth = std::min(static_cast<int>(maxTextureSize), kStripMaxTileWidth);
 
-    FT_GlyphSlot g = face_->glyph;
-    int originalWidth = g->bitmap.width;
-    int originalHeight = g->bitmap.rows;
+    // 描画先の切り替えで呼び出し元のFBOとビューポートを壊さないよう退避する
+    GLint previousFramebuffer = 0;
+    GLint previousViewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
 
-    // アウトライン幅の分だけパディングを追加する
-    int padding = static_cast<int>(outlinePixelWidth_);
-    int paddingX = padding + 1;
-    int paddingY = padding + 1;
+    if (!stripFbo_)
+        glGenFramebuffers(1, &stripFbo_);
+    glBindFramebuffer(GL_FRAMEBUFFER, stripFbo_);
 
-    int expandedWidth = originalWidth + paddingX * 2;
-    int expandedHeight = originalHeight + paddingY * 2;
+    // RGBは乗算済みアルファで書き込み、画面へはGL_ONEで合成する
+    glState_->useProgram(telopProgram_);
+    glState_->setBlendEnabled(true);
+    glState_->blendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+    bool ok = true;
+    for (int tileX = 0; tileX < stripWidth; tileX += tileWidth)
+    {
+        StripTile tile;
+        tile.width = std::min(tileWidth, stripWidth - tileX);
+        glGenTextures(1, &tile.texture);
+        glState_->bindTexture(GL_TEXTURE0, tile.texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tile.width, lane.stripHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        lane.stripTiles.push_back(tile);
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tile.texture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cerr << "[TelopRenderer] Telop strip framebuffer is not complete." << std::endl;
+            ok = false;
+            break;
+        }
+        glViewport(0, 0, tile.width, lane.stripHeight);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        // タイルの左端がストリップ座標 tileX に来るようにペン位置をずらして描く
+        beginGlyphBatch(tile.width, lane.stripHeight);
+        appendLaneGlyphs(lane, lane.stripOriginX - tileX, lane.stripBaseline, tile.width);
+        drawGlyphBatch();
+    }
 
-    // 拡張バッファの作成（α値のみ）
-    std::vector<unsigned char> expandedBuffer(expandedWidth * expandedHeight, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
 
-    // 中央にビットマップを配置（行単位でコピー）
-    for (int row = 0; row < originalHeight; ++row)
+    if (!ok)
     {
-        memcpy(&expandedBuffer[(row + paddingY) * expandedWidth + paddingX],
-               &g->bitmap.buffer[row * originalWidth],
-               originalWidth);
+        destroyStripTiles(lane);
+        return false;
+    }
+    std::cout << "[TelopRenderer] Rendered telop strip " << stripWidth << "x" << lane.stripHeight << " into "
+              << lane.stripTiles.size() << " tile(s)." << std::endl;
+    return true;
+}
+
+void TelopRenderer::renderStrips()
+{
+    // 全レーンのうち画面に掛かるタイルだけを1枚の四角形として並べる（文字列の描き直しは行わない）
+    batchVertices_.clear();
+    stripVisibleTiles_.clear();
+    for (const Lane &lane : lanes_)
+    {
+        const float top = lane.baselineY - lane.stripBaseline;
+        const float bottom = top + lane.stripHeight;
+        float left = lane.penX - lane.stripOriginX;
+        for (const StripTile &tile : lane.stripTiles)
+        {
+            const float right = left + tile.width;
+            if (right >= 0.0f && left <= screenWidth_)
+            {
+                // FBOに描いたタイルは上下が反転しているので、上端に v=1 を割り当てる
+                const float quad[6 * kStripVertexFloats] = {
+                    left, bottom, 0.0f, 0.0f,
+                    left, top, 0.0f, 1.0f,
+                    right, top, 1.0f, 1.0f,
+
+                    left, bottom, 0.0f, 0.0f,
+                    right, top, 1.0f, 1.0f,
+                    right, bottom, 1.0f, 0.0f,
+                };
+                batchVertices_.insert(batchVertices_.end(), quad, quad + 6 * kStripVertexFloats);
+                stripVisibleTiles_.push_back(tile.texture);
+            }
+            left = right;
+        }
+    }
+    if (batchVertices_.empty())
+        return;
+
+    glState_->useProgram(stripProgram_);
+    glState_->setBlendEnabled(true);
+    glState_->blendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glState_->uniform2f(stripUniformResolution_, (float)screenWidth_, (float)screenHeight_);
+    glState_->uniform1i(stripUniformTexture_, 0);
+
+    glState_->bindArrayBuffer(vbo_);
+    glBufferData(GL_ARRAY_BUFFER, batchVertices_.size() * sizeof(float), batchVertices_.data(), GL_DYNAMIC_DRAW);
+    glState_->enableVertexAttribArray(stripAttrPosition_);
+    glState_->vertexAttribPointer(stripAttrPosition_, 2, sizeof(float) * kStripVertexFloats, 0);
+    glState_->enableVertexAttribArray(stripAttrTexCoord_);
+    glState_->vertexAttribPointer(stripAttrTexCoord_, 2, sizeof(float) * kStripVertexFloats, sizeof(float) * 2);
+
+    for (size_t i = 0; i < stripVisibleTiles_.size(); ++i)
+    {
+        glState_->bindTexture(GL_TEXTURE0, stripVisibleTiles_[i]);
+        glDrawArrays(GL_TRIANGLES, static_cast<GLint>(i * 6), 6);
+    }
+
+    glState_->disableVertexAttribArray(stripAttrTexCoord_);
+    glState_->disableVertexAttribArray(stripAttrPosition_);
+}
+
+void TelopRenderer::destroyStripTiles(Lane &lane)
+{
+    for (StripTile &tile : lane.stripTiles)
+    {
+        glState_->forgetTexture(tile.texture);
+        glDeleteTextures(1, &tile.texture);
     }
+    lane.stripTiles.clear();
+}
+
+void TelopRenderer::uploadGlyph(const GlyphRasterizer::Result &result)
+{
+    const GlyphRasterizer::Request &request = result.request;
+    GlyphStyle style;
+    style.face = request.face;
+    style.pixelSize = request.pixelSize;
+    style.padding = request.padding;
+    style.sdf = request.format == GlyphRasterizer::Format::SDF;
+    const wchar_t c = request.code;
+    const GlyphCache::Key key = glyphKey(style, c);
+    requestedGlyphs_.erase(key);
+    // フィードのスレッドと描画スレッドの両方から依頼された場合など、既に格納済みなら2つ目の結果は捨てる
+    if (glyphCache_.find(key))
+        return;
 
-    // OpenGL テクスチャ生成
-    GLuint tex;
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, expandedWidth, expandedHeight, 0,
-                 GL_ALPHA, GL_UNSIGNED_BYTE, expandedBuffer.data());
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // アトラスに格納。予算いっぱいなら使われていないグリフを追い出して空きを作る
+    GlyphAtlas::Region region;
+    bool stored = result.ok;
+    while (stored && !atlas_.insert(result.pixels.data(), result.width, result.height, region))
+    {
+        stored = atlas_.fitsInPage(result.width, result.height) && makeRoomForGlyph(result.width, result.height);
+    }
+    if (!stored)
+    {
+        std::cerr << "[TelopRenderer] Failed to load glyph U+" << std::hex << static_cast<uint32_t>(c) << std::dec
+                  << std::endl;
+        failedGlyphs_.insert(key);
+        forgetFeedGlyph(key);
+        return;
+    }
+    failedGlyphs_.erase(key);
 
-    // Glyph をキャッシュ（描画オフセットも調整）
+    // Glyph をキャッシュ（描画オフセットはパディング込み）
     Glyph glyph = {
-        tex,
-        expandedWidth,
-        expandedHeight,
-        g->bitmap_left - paddingX,
-        g->bitmap_top + paddingY,
-        static_cast<int>(g->advance.x >> 6)};
-
-    glyphCache_[c] = glyph;
+        region,
+        result.width,
+        result.height,
+        result.bearingX,
+        result.bearingY,
+        result.advance};
+
+    glyphCache_.insert(key, glyph);
+}
+
+void TelopRenderer::updatePinnedGlyphs()
+{
+    // 作り直すのはグリフを追い出す必要が生じた時だけにし、文字列の切り替え自体は軽く保つ
+    pinnedGlyphsDirty_ = true;
+}
+
+void TelopRenderer::rebuildPinnedGlyphs()
+{
+    if (!pinnedGlyphsDirty_)
+        return;
+    pinnedGlyphs_.clear();
+    for (const Lane &lane : lanes_)
+    {
+        for (wchar_t c : lane.text)
+            pinnedGlyphs_.insert(glyphKey(lane.textStyle, c));
+        pinnedGlyphs_.insert(lane.pendingKeys.begin(), lane.pendingKeys.end());
+    }
+    pinnedGlyphsDirty_ = false;
+}
+
+bool TelopRenderer::makeRoomForGlyph(int width, int height)
+{
+    // 解放した枠は隣と結合しないので、小さなグリフをいくつ追い出しても大きなグリフは入らない。
+    // 収まる枠を持つグリフのうち、最も長く使われていないものを1つだけ追い出す
+    rebuildPinnedGlyphs();
+    Glyph evicted;
+    GlyphCache::Key evictedKey = 0;
+    if (glyphCache_.evictLeastRecentlyUsedIf(
+            pinnedGlyphs_, [&](const Glyph &glyph) { return atlas_.canReuse(glyph.region, width, height); }, evicted,
+            &evictedKey))
+    {
+        atlas_.release(evicted.region);
+        forgetFeedGlyph(evictedKey);
+        return true;
+    }
+
+    // 収まる枠が無ければ（長時間の運用で細かく分かれた場合など）、表示中のグリフを含まないページを
+    // 1つだけ丸ごと空け、棚を作り直す
+    const int page = findReclaimablePage();
+    if (page < 0)
+    {
+        std::cerr << "[TelopRenderer] Glyph cache budget is too small for the current text." << std::endl;
+        return false;
+    }
+    const size_t count =
+        glyphCache_.evictAllIf(pinnedGlyphs_, [page](const Glyph &glyph) { return glyph.region.page == page; });
+    atlas_.resetPage(page);
+    forgetAllFeedGlyphs();
+    std::cout << "[TelopRenderer] Reclaimed glyph atlas page " << page << " (" << count << " glyphs evicted)."
+              << std::endl;
     return true;
 }
 
-void TelopRenderer::renderGlyph(const Glyph &glyph, float x, float y, float alpha)
-{
-    float xpos = x + glyph.bearingX;
-    float ypos = y - glyph.bearingY;
-    float w = glyph.width;
-    float h = glyph.height;
-
-    float vertices[24] = {
-        xpos,
-        ypos + h,
-        0.0f,
-        0.0f,
-        xpos,
-        ypos,
-        0.0f,
-        1.0f,
-        xpos + w,
-        ypos,
-        1.0f,
-        1.0f,
-
-        xpos,
-        ypos + h,
-        0.0f,
-        0.0f,
-        xpos + w,
-        ypos,
-        1.0f,
-        1.0f,
-        xpos + w,
-        ypos + h,
-        1.0f,
-        0.0f,
-    };
+int TelopRenderer::findReclaimablePage() const
+{
+    // 表示中・表示待ちのグリフが無いページのうち、格納しているグリフが最も少ないもの
+    const int pageCount = atlas_.getPageCount();
+    std::vector<int> glyphCounts(pageCount, 0);
+    std::vector<bool> pinned(pageCount, false);
+    glyphCache_.forEachLeastRecentFirst([&](GlyphCache::Key, const Glyph &glyph) {
+        if (glyph.region.page >= 0 && glyph.region.page < pageCount)
+            glyphCounts[glyph.region.page]++;
+    });
+    for (GlyphCache::Key key : pinnedGlyphs_)
+    {
+        const Glyph *glyph = glyphCache_.find(key);
+        if (glyph && glyph->region.page >= 0 && glyph->region.page < pageCount)
+            pinned[glyph->region.page] = true;
+    }
 
-    glUseProgram(telopProgram_);
+    int best = -1;
+    for (int page = 0; page < pageCount; ++page)
+    {
+        if (!pinned[page] && (best < 0 || glyphCounts[page] < glyphCounts[best]))
+            best = page;
+    }
+    return best;
+}
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+void TelopRenderer::setGlyphCacheBudget(size_t bytes)
+{
+    glyphCacheBudget_ = bytes;
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_DYNAMIC_DRAW);
+void TelopRenderer::setGlyphCacheFile(const std::string &path)
+{
+    glyphCacheFile_ = path;
+}
+
+bool TelopRenderer::saveGlyphCacheFile() const
+{
+    if (glyphCacheFile_.empty() || !glState_)
+        return false;
+    return GlyphCacheFile::save(glyphCacheFile_, glyphCacheIdentity_, atlas_, glyphCache_);
+}
+
+bool TelopRenderer::hasPendingText() const
+{
+    for (const Lane &lane : lanes_)
+    {
+        if (lane.textPending)
+            return true;
+    }
+    return false;
+}
 
-    glEnableVertexAttribArray(attrPosition_);
-    glVertexAttribPointer(attrPosition_, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 4, (void *)0);
+GlyphCache::Stats TelopRenderer::getGlyphCacheStats() const
+{
+    return glyphCache_.getStats();
+}
 
-    glEnableVertexAttribArray(attrTexCoord_);
-    glVertexAttribPointer(attrTexCoord_, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 4, (void *)(sizeof(float) * 2));
+size_t TelopRenderer::getGlyphCacheBytes() const
+{
+    return atlas_.getTextureBytes();
+}
 
-    glUniform2f(uniformResolution_, (float)screenWidth_, (float)screenHeight_);
-    glUniform4fv(uniformOutlineColor_, 1, outlineColor_);
-    glUniform1f(uniformOutlinePixelWidth_, outlineEnabled_ ? outlinePixelWidth_ : 0.0f);
-    glUniform1i(uniformEnableOutline_, outlineEnabled_ ? 1 : 0);
-    glUniform2f(uniformTextureSize_, (float)glyph.width, (float)glyph.height);
-    glUniform1f(uniformMarginSize_, marginSize_);
+void TelopRenderer::appendGlyphQuad(const Glyph &glyph, float x, float y, float scale, const float color[4],
+                                    std::vector<float> &vertices)
+{
+    float xpos = x + glyph.bearingX * scale;
+    float ypos = y - glyph.bearingY * scale;
+    float w = glyph.width * scale;
+    float h = glyph.height * scale;
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, glyph.textureID);
-    glUniform1i(uniformTexture_, 0);
+    const GlyphAtlas::Region &r = glyph.region;
 
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    // 画像の1行目（v0）が上端(ypos)に来るように並べる
+    const float corners[6][4] = {
+        {xpos, ypos + h, r.u0, r.v1},
+        {xpos, ypos, r.u0, r.v0},
+        {xpos + w, ypos, r.u1, r.v0},
 
-    glDisableVertexAttribArray(attrTexCoord_);
-    glDisableVertexAttribArray(attrPosition_);
+        {xpos, ypos + h, r.u0, r.v1},
+        {xpos + w, ypos, r.u1, r.v0},
+        {xpos + w, ypos + h, r.u1, r.v1},
+    };
+    // 各頂点に文字色と拡大率を付け、レーン毎のuniform設定を不要にする
+    for (const float(&corner)[4] : corners)
+    {
+        vertices.insert(vertices.end(), corner, corner + 4);
+        vertices.insert(vertices.end(), color, color + 4);
+        vertices.push_back(scale);
+    }
 }
 
 void TelopRenderer::checkGLError(const char *label)
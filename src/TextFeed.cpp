@@ -0,0 +1,317 @@
+#include "TextFeed.h"
+#include <algorithm>
+#include <codecvt>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <locale>
+#include <stdexcept>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+    // 1行（1つの文字列）の上限。これを超えた分は次の行として扱う
+    constexpr size_t kMaxLineBytes = 64 * 1024;
+}
+
+TextFeed::TextFeed()
+{
+}
+
+TextFeed::~TextFeed()
+{
+    stop();
+}
+
+bool TextFeed::startSocket(const std::string &path)
+{
+    stop();
+
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "[TextFeed] Invalid socket path: " << path << std::endl;
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size());
+
+    listenFd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd_ < 0)
+    {
+        std::cerr << "[TextFeed] Failed to create socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    unlink(path.c_str());
+    if (bind(listenFd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || listen(listenFd_, 4) < 0)
+    {
+        std::cerr << "[TextFeed] Failed to listen on " << path << ": " << std::strerror(errno) << std::endl;
+        stop();
+        return false;
+    }
+
+    path_ = path;
+    if (!startWorker())
+        return false;
+    std::cout << "[TextFeed] Listening on " << path << std::endl;
+    return true;
+}
+
+bool TextFeed::startFile(const std::string &path)
+{
+    stop();
+
+    // 置き換え（rename）でも追従できるよう、ファイルではなく親ディレクトリを監視する
+    const size_t slash = path.find_last_of('/');
+    const std::string directory = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    fileName_ = slash == std::string::npos ? path : path.substr(slash + 1);
+
+    inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd_ < 0)
+    {
+        std::cerr << "[TextFeed] Failed to initialize inotify: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    watchFd_ = inotify_add_watch(inotifyFd_, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (watchFd_ < 0)
+    {
+        std::cerr << "[TextFeed] Failed to watch " << directory << ": " << std::strerror(errno) << std::endl;
+        stop();
+        return false;
+    }
+
+    path_ = path;
+    // 起動時点の内容を最初の文字列にする（まだ無ければ作成されるのを待つ）
+    readFile();
+    if (!startWorker())
+        return false;
+    std::cout << "[TextFeed] Watching " << path << std::endl;
+    return true;
+}
+
+bool TextFeed::startWorker()
+{
+    wakeFd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wakeFd_ < 0)
+    {
+        std::cerr << "[TextFeed] Failed to create eventfd: " << std::strerror(errno) << std::endl;
+        stop();
+        return false;
+    }
+    stopping_.store(false, std::memory_order_relaxed);
+    if (listenFd_ >= 0)
+        thread_ = std::thread(&TextFeed::socketLoop, this);
+    else
+        thread_ = std::thread(&TextFeed::fileLoop, this);
+    return true;
+}
+
+void TextFeed::stop()
+{
+    stopping_.store(true, std::memory_order_relaxed);
+    if (thread_.joinable())
+    {
+        const uint64_t one = 1;
+        if (write(wakeFd_, &one, sizeof(one)) < 0)
+            std::cerr << "[TextFeed] Failed to wake the feed thread: " << std::strerror(errno) << std::endl;
+        thread_.join();
+    }
+
+    if (listenFd_ >= 0)
+    {
+        close(listenFd_);
+        unlink(path_.c_str());
+        listenFd_ = -1;
+    }
+    if (inotifyFd_ >= 0)
+    {
+        close(inotifyFd_); // 監視も一緒に解除される
+        inotifyFd_ = -1;
+        watchFd_ = -1;
+    }
+    if (wakeFd_ >= 0)
+    {
+        close(wakeFd_);
+        wakeFd_ = -1;
+    }
+}
+
+bool TextFeed::isRunning() const
+{
+    return thread_.joinable();
+}
+
+void TextFeed::setLayoutBuilder(LayoutBuilder builder)
+{
+    layoutBuilder_ = std::move(builder);
+}
+
+bool TextFeed::poll(Layout &layout)
+{
+    if (!buffer_.consume())
+        return false;
+    Layout &update = buffer_.front();
+    layout.utf8.swap(update.utf8);
+    layout.text.swap(update.text);
+    layout.glyphKeys.swap(update.glyphKeys);
+    layout.glyphFlags.swap(update.glyphFlags);
+    layout.style = update.style;
+    layout.generation = update.generation;
+    return true;
+}
+
+void TextFeed::publish(const std::string &utf8)
+{
+    Layout &update = buffer_.back();
+    try
+    {
+        std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+        update.text = converter.from_bytes(utf8);
+    }
+    catch (const std::range_error &)
+    {
+        std::cerr << "[TextFeed] Ignoring text that is not valid UTF-8." << std::endl;
+        return;
+    }
+    update.utf8 = utf8;
+    update.glyphKeys.clear();
+    update.glyphFlags.clear();
+    if (layoutBuilder_)
+        layoutBuilder_(update);
+    buffer_.publish();
+}
+
+void TextFeed::socketLoop()
+{
+    int clientFd = -1;
+    std::string line;
+    char chunk[4096];
+
+    while (!stopping_.load(std::memory_order_relaxed))
+    {
+        // 接続中は1クライアントから読み、切断されたら次の接続を待つ
+        pollfd fds[2];
+        fds[0].fd = wakeFd_;
+        fds[0].events = POLLIN;
+        fds[1].fd = clientFd >= 0 ? clientFd : listenFd_;
+        fds[1].events = POLLIN;
+        if (::poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "[TextFeed] poll() failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        if (fds[0].revents)
+            break;
+        if (!fds[1].revents)
+            continue;
+
+        if (clientFd < 0)
+        {
+            clientFd = accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (clientFd < 0 && errno != EINTR && errno != EAGAIN)
+                std::cerr << "[TextFeed] accept() failed: " << std::strerror(errno) << std::endl;
+            continue;
+        }
+
+        const ssize_t received = read(clientFd, chunk, sizeof(chunk));
+        if (received > 0)
+        {
+            for (ssize_t i = 0; i < received; ++i)
+            {
+                if (chunk[i] == '\n' || line.size() >= kMaxLineBytes)
+                {
+                    if (!line.empty() && line.back() == '\r')
+                        line.pop_back();
+                    publish(line);
+                    line.clear();
+                    if (chunk[i] == '\n')
+                        continue;
+                }
+                line.push_back(chunk[i]);
+            }
+            continue;
+        }
+        if (received < 0 && errno == EINTR)
+            continue;
+
+        // 切断。改行で終わらなかった最後の行も1つの文字列として扱う
+        if (!line.empty())
+        {
+            publish(line);
+            line.clear();
+        }
+        close(clientFd);
+        clientFd = -1;
+    }
+
+    if (clientFd >= 0)
+        close(clientFd);
+}
+
+void TextFeed::fileLoop()
+{
+    // inotify_event は名前の分だけ可変長なので、アラインメントを揃えたバッファで受ける
+    alignas(inotify_event) char events[4096];
+
+    while (!stopping_.load(std::memory_order_relaxed))
+    {
+        pollfd fds[2];
+        fds[0].fd = wakeFd_;
+        fds[0].events = POLLIN;
+        fds[1].fd = inotifyFd_;
+        fds[1].events = POLLIN;
+        if (::poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "[TextFeed] poll() failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        if (fds[0].revents)
+            break;
+
+        bool changed = false;
+        ssize_t length;
+        while ((length = read(inotifyFd_, events, sizeof(events))) > 0)
+        {
+            for (char *p = events; p < events + length;)
+            {
+                const inotify_event *event = reinterpret_cast<const inotify_event *>(p);
+                if (event->len > 0 && fileName_ == event->name)
+                    changed = true;
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+        // 連続した書き込みは1回の読み込みにまとめる
+        if (changed)
+            readFile();
+    }
+}
+
+bool TextFeed::readFile()
+{
+    std::ifstream file(path_, std::ios::binary);
+    if (!file)
+        return false;
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    // テロップは1行なので、末尾の改行は取り除き、途中の改行は空白にする
+    while (!text.empty() && (text.back() == '\n' || text.back() == '\r'))
+        text.pop_back();
+    std::replace(text.begin(), text.end(), '\r', ' ');
+    std::replace(text.begin(), text.end(), '\n', ' ');
+    publish(text);
+    return true;
+}
@@ -0,0 +1,308 @@
+#include "TraceRecorder.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdarg>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+std::atomic<bool> TraceRecorder::enabled_{false};
+
+namespace
+{
+    int64_t toNanoseconds(std::chrono::steady_clock::time_point time)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
+
+    // JSON の文字列として書けるよう、スレッド名の特殊文字を置き換える
+    std::string escapeJson(const std::string &text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                escaped.push_back('\\');
+            escaped.push_back(static_cast<unsigned char>(c) < 0x20 ? ' ' : c);
+        }
+        return escaped;
+    }
+
+    // printf 形式で書式化して out に書く。固定長バッファに収まらない分は切り捨てる
+    void writeFormatted(std::ostream &out, const char *format, ...)
+    {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        const int length = std::vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        if (length > 0)
+            out.write(buffer, std::min<int>(length, sizeof(buffer) - 1));
+    }
+
+    void onDumpSignal(int)
+    {
+        TraceRecorder::instance().requestDump();
+    }
+}
+
+TraceRecorder &TraceRecorder::instance()
+{
+    static TraceRecorder recorder;
+    return recorder;
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    stopDumpThread();
+}
+
+bool TraceRecorder::start(const std::string &path, size_t eventsPerThread)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (path.empty() || eventsPerThread == 0)
+    {
+        std::cerr << "[Trace] Invalid trace settings." << std::endl;
+        return false;
+    }
+    path_ = path;
+    // 書き込み位置をマスクで求められるよう、2のべき乗に切り上げる
+    eventsPerThread_ = 1;
+    while (eventsPerThread_ < eventsPerThread)
+        eventsPerThread_ <<= 1;
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = &onDumpSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGUSR1, &action, nullptr) != 0)
+        std::cerr << "[Trace] Failed to install the SIGUSR1 handler. The trace is written only on exit." << std::endl;
+
+    if (!dumpThread_.joinable())
+    {
+        dumpStopping_ = false;
+        dumpThread_ = std::thread(&TraceRecorder::dumpLoop, this);
+    }
+
+    // バッファの大きさを決めてから記録を有効にする
+    enabled_.store(true, std::memory_order_release);
+    std::cout << "[Trace] Recording " << eventsPerThread_ << " events per thread. Send SIGUSR1 (kill -USR1 " << getpid()
+              << ") to write " << path_ << std::endl;
+    return true;
+}
+
+void TraceRecorder::stop()
+{
+    if (!enabled_.exchange(false, std::memory_order_relaxed))
+        return;
+    // 既定の動作に戻すと、後から届いた SIGUSR1 でプロセスが終了してしまうので無視する
+    signal(SIGUSR1, SIG_IGN);
+    stopDumpThread();
+    dump();
+}
+
+void TraceRecorder::stopDumpThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(dumpMutex_);
+        dumpStopping_ = true;
+    }
+    dumpCondition_.notify_one();
+    if (dumpThread_.joinable())
+        dumpThread_.join();
+}
+
+void TraceRecorder::dumpLoop()
+{
+    // 描画ループと同じコアで動く場合でも描画を優先させる（Linux では nice 値をスレッド毎に持つ）
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+    std::unique_lock<std::mutex> lock(dumpMutex_);
+    while (true)
+    {
+        dumpCondition_.wait(lock, [this]() { return dumpPending_ || dumpStopping_; });
+        if (dumpStopping_)
+            break;
+        dumpPending_ = false;
+        // 書き出している間も次の依頼を受け付けられるよう、ロックを外す
+        lock.unlock();
+        dump();
+        lock.lock();
+    }
+}
+
+TraceRecorder::ThreadBuffer *TraceRecorder::threadBuffer()
+{
+    // スレッドが終了してもバッファはレコーダが持ち続け、書き出しに含める
+    thread_local ThreadBuffer *buffer = nullptr;
+    if (buffer)
+        return buffer;
+
+    // スレッドの初回の記録でだけロックを取り、バッファを確保する
+    std::unique_ptr<ThreadBuffer> created(new ThreadBuffer());
+    created->events.resize(eventsPerThread_);
+    created->tid = static_cast<int>(syscall(SYS_gettid));
+    char name[16] = {};
+    if (pthread_getname_np(pthread_self(), name, sizeof(name)) == 0)
+        created->threadName = name;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffer = created.get();
+    buffers_.push_back(std::move(created));
+    return buffer;
+}
+
+void TraceRecorder::push(const Event &event)
+{
+    ThreadBuffer *buffer = threadBuffer();
+    const uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    buffer->events[head & (buffer->events.size() - 1)] = event;
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void TraceRecorder::complete(const char *name, std::chrono::steady_clock::time_point start,
+                             std::chrono::steady_clock::time_point end)
+{
+    Event event;
+    event.name = name;
+    event.timestampNs = toNanoseconds(start);
+    event.durationNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    event.phase = 'X';
+    push(event);
+}
+
+void TraceRecorder::instant(const char *name, const char *argName, int64_t arg)
+{
+    Event event;
+    event.name = name;
+    event.argName = argName;
+    event.arg = arg;
+    event.timestampNs = toNanoseconds(std::chrono::steady_clock::now());
+    event.phase = 'i';
+    push(event);
+}
+
+void TraceRecorder::counter(const char *name, int64_t value)
+{
+    Event event;
+    event.name = name;
+    event.argName = "value";
+    event.arg = value;
+    event.timestampNs = toNanoseconds(std::chrono::steady_clock::now());
+    event.phase = 'C';
+    push(event);
+}
+
+void TraceRecorder::requestDump()
+{
+    dumpRequested_.store(true, std::memory_order_relaxed);
+}
+
+bool TraceRecorder::dumpIfRequested()
+{
+    if (!dumpRequested_.load(std::memory_order_relaxed))
+        return false;
+    dumpRequested_.store(false, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(dumpMutex_);
+        if (!dumpThread_.joinable())
+            return false;
+        dumpPending_ = true;
+    }
+    dumpCondition_.notify_one();
+    return true;
+}
+
+bool TraceRecorder::dump()
+{
+    struct ThreadEvents
+    {
+        int tid;
+        std::string threadName;
+        std::vector<Event> events;
+    };
+    std::vector<ThreadEvents> threads;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const std::unique_ptr<ThreadBuffer> &buffer : buffers_)
+        {
+            // 書き込み中のスレッドと並行して写すので、写している間に上書きされた可能性のある古い分は捨てる
+            const uint64_t capacity = buffer->events.size();
+            const uint64_t end = buffer->head.load(std::memory_order_acquire);
+            uint64_t begin = end > capacity ? end - capacity : 0;
+            ThreadEvents copy;
+            copy.tid = buffer->tid;
+            copy.threadName = buffer->threadName;
+            copy.events.reserve(end - begin);
+            for (uint64_t i = begin; i < end; ++i)
+                copy.events.push_back(buffer->events[i & (capacity - 1)]);
+            const uint64_t after = buffer->head.load(std::memory_order_acquire);
+            if (after > capacity && after - capacity > begin)
+            {
+                const uint64_t overwritten = std::min(after - capacity, end) - begin;
+                copy.events.erase(copy.events.begin(), copy.events.begin() + overwritten);
+            }
+            threads.push_back(std::move(copy));
+        }
+    }
+
+    // 書き出し途中のファイルを読まれないよう、一時ファイルに書いてから置き換える
+    const std::string temporaryPath = path_ + ".tmp";
+    std::ofstream out(temporaryPath, std::ios::trunc);
+    if (!out)
+    {
+        std::cerr << "[Trace] Failed to open " << temporaryPath << " for writing." << std::endl;
+        return false;
+    }
+
+    const int pid = static_cast<int>(getpid());
+    size_t eventCount = 0;
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"args\":{\"name\":\"raspi_gl\"}}";
+    for (const ThreadEvents &thread : threads)
+    {
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << thread.tid
+            << ",\"args\":{\"name\":\"" << escapeJson(thread.threadName) << "\"}}";
+        for (const Event &event : thread.events)
+        {
+            // 時刻はus単位の小数で書く
+            writeFormatted(out, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":%d,\"tid\":%d,\"ts\":%" PRId64 ".%03d",
+                           event.name, event.phase, pid, thread.tid, event.timestampNs / 1000,
+                           static_cast<int>(event.timestampNs % 1000));
+            if (event.phase == 'X')
+            {
+                writeFormatted(out, ",\"dur\":%" PRId64 ".%03d", event.durationNs / 1000,
+                               static_cast<int>(event.durationNs % 1000));
+            }
+            else if (event.phase == 'i')
+            {
+                out << ",\"s\":\"t\"";
+            }
+            if (event.argName)
+            {
+                writeFormatted(out, ",\"args\":{\"%s\":%" PRId64 "}", event.argName, event.arg);
+            }
+            out << '}';
+            ++eventCount;
+        }
+    }
+    out << "\n]}\n";
+
+    const bool ok = static_cast<bool>(out.flush());
+    out.close();
+    if (!ok || std::rename(temporaryPath.c_str(), path_.c_str()) != 0)
+    {
+        std::cerr << "[Trace] Failed to write " << path_ << std::endl;
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+    std::cout << "[Trace] Wrote " << eventCount << " events from " << threads.size() << " thread(s) to " << path_
+              << std::endl;
+    return true;
+}